@@ -1,36 +1,175 @@
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include "opcalc.hpp"
+#include "opcalcscan.hpp"
 
 namespace OPParser {
-    class NumToken;
-    class FuncToken;
-    class AssignToken;
-    class BiToken;
-    class MonoToken;
+    template <class T> class NumToken;
+    template <class T> class NameToken;
+    template <class T> class CallToken;
+    template <class T> class FuncToken;
+    template <class T> class AssignToken;
+    template <class T> class BiToken;
+    template <class T> class MonoToken;
+    template <class T> class CondToken;
+    template <class T> class ElseToken;
     class LeftToken;
     class RightToken;
-    typedef shared_ptr <NumToken    > PNumToken;
-    typedef shared_ptr <FuncToken   > PFuncToken;
-    typedef shared_ptr <AssignToken > PAssignToken;
-    typedef shared_ptr <BiToken     > PBiToken;
-    typedef shared_ptr <MonoToken   > PMonoToken;
+    template <class T> using PNumToken = shared_ptr <NumToken <T>>;
+    template <class T> using PCondToken = shared_ptr <CondToken <T>>;
+    template <class T> using PElseToken = shared_ptr <ElseToken <T>>;
     typedef shared_ptr <LeftToken   > PLeftToken;
     typedef shared_ptr <RightToken  > PRightToken;
 
+    // Exact integer arithmetic
+    // Return false if the result can not be represented by CalcInt
+
+    bool intAdd(const CalcInt left, const CalcInt right, CalcInt &result) {
+        return !__builtin_add_overflow(left, right, &result);
+    }
+
+    bool intSub(const CalcInt left, const CalcInt right, CalcInt &result) {
+        return !__builtin_sub_overflow(left, right, &result);
+    }
+
+    bool intMul(const CalcInt left, const CalcInt right, CalcInt &result) {
+        return !__builtin_mul_overflow(left, right, &result);
+    }
+
+    bool intMod(const CalcInt left, const CalcInt right, CalcInt &result) {
+        if (right == 0) {
+            return 0;
+        }
+
+        // Avoid overflow of INT64_MIN % -1
+        result = right == -1 ? 0 : left % right;
+        return 1;
+    }
+
+    bool intPwr(CalcInt left, CalcInt right, CalcInt &result) {
+        if (right < 0) {
+            return 0;
+        }
+
+        // Exponentiation by squaring
+        result = 1;
+        while (right) {
+            if ((right & 1) && !intMul(result, left, result)) {
+                return 0;
+            }
+            right >>= 1;
+            if (right && !intMul(left, left, left)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    bool intFac(const CalcInt target, CalcInt &result) {
+        // 21! is out of range
+        if (target < 0 || target > 20) {
+            return 0;
+        }
+
+        result = 1;
+        for (CalcInt i = 2; i <= target; ++i) {
+            result *= i;
+        }
+        return 1;
+    }
+
+    // Convert a rounded value to integer
+    template <class T> bool intFromData(const T value, CalcInt &result) {
+        // Also false if value is NaN
+        if (value >= -9223372036854775808.0 && value < 9223372036854775808.0) {
+            result = CalcInt(value);
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+
+    // Convert a value to integer if no information will be lost
+    template <class T> bool intFromExactData(const T value, CalcInt &result) {
+        // Integers above 2^digits (2^53 for double) may come from rounding
+        const T limit = T(uint64_t(1) << min(calcDigits <T> (), 63));
+
+        return value >= -limit && value <= limit && value == trunc(value) && !(value == 0 && signbit(value))
+               && intFromData(value, result);
+    }
+
+    // Derivative of gamma(x) / gamma(x), for differentiation
+    template <class T> T digamma(T target) {
+        T result = 0;
+
+        // Reflection, psi(1 - x) - psi(x) = pi cot(pi x)
+        if (target <= 0) {
+            if (target == floor(target)) {
+                return T(NAN);
+            }
+            result -= calcPi <T> () / tan(calcPi <T> () * target);
+            target = 1 - target;
+        }
+
+        // Recurrence, psi(x) = psi(x + 1) - 1 / x
+        for (; target < 6; target += 1) {
+            result -= 1 / target;
+        }
+
+        // Asymptotic series
+        const T inv2 = 1 / (target * target);
+        result += log(target) - 0.5 / target
+                  - inv2 * (T(1) / 12 - inv2 * (T(1) / 120 - inv2 * (T(1) / 252 - inv2 * (T(1) / 240 - inv2 / 132))));
+
+        return result;
+    }
+
     // Tokens
 
     // Number
-    class NumToken: public Token {
+    template <class T> class NumToken: public Token {
     protected:
-        CalcData value = 0;
+        T value = 0;
+
+        // Exact value, valid if isInt
+        // value is kept as the nearest T
+        bool isInt = 0;
+        CalcInt intValue = 0;
+
+        // Derivatives by Calc's differentiation names, empty if constant
+        vector <T> deriv = {};
+
+        void setData(const T toValue) {
+            value = toValue;
+            isInt = 0;
+        }
+
+        void setInt(const CalcInt toValue) {
+            value = T(toValue);
+            isInt = 1;
+            intValue = toValue;
+        }
+
+        // Chain rule of a function with given derivative
+        void chain(const T factor) {
+            for (T &item: deriv) {
+                item *= factor;
+            }
+        }
     public:
-        friend class Calc;
-        friend class FuncToken;
-        friend class AssignToken;
-        friend class BiToken;
-        friend class MonoToken;
+        friend class BasicCalc <T>;
+        friend class FuncToken <T>;
+        friend class AssignToken <T>;
+        friend class BiToken <T>;
+        friend class MonoToken <T>;
+        friend class CondToken <T>;
+        friend class ElseToken <T>;
+        friend class NameLexer <T>;
+
+        NumToken(T toValue): value(toValue) {}
 
-        NumToken(CalcData toValue): value(toValue) {}
+        NumToken(CalcInt toValue): value(T(toValue)), isInt(1), intValue(toValue) {}
 
         Level levelLeft() const {
             return levelConst;
@@ -45,141 +184,421 @@ namespace OPParser {
         }
 
         void onPop(Parser &parser) {
+            BasicCalcProgram <T> *program = ((BasicCalc <T> &) parser).program;
+            if (program) {
+                program->pushNum(value);
+            }
+
             parser.outStack.push_back(shared_from_this());
         }
+
+        bool save(TokenBuffer &tokens) const {
+            if (isInt) {
+                tokens.push(tkInt, uint64_t(intValue));
+            } else {
+                tokens.push(tkReal, tokens.pushText(Input((const char *) &value, sizeof(T))));
+            }
+            return 1;
+        }
     };
 
-    // Functions
-    class FuncToken: public Token {
+    // Value depends on parameters, when compiling
+    // Operations are already recorded to the program, it only keeps the place on the output stack
+    template <class T> class ParamToken: public NumToken <T> {
+    public:
+        ParamToken(): NumToken <T> (T(NAN)) {}
+
+        void onPop(Parser &parser) {
+            parser.outStack.push_back(this->shared_from_this());
+        }
+    };
+
+    // Name of a parameter, constant or variable
+    // Looked up when popped, so names assigned before in the same input are found
+    template <class T> class NameToken: public NumToken <T> {
     protected:
-        FuncType type;
+        Input name;
+
+        // Offset in the input, for errors
+        size_t offset = 0;
     public:
-        FuncToken(FuncType toType): type(toType) {}
+        NameToken(const Input &toName): NumToken <T> (T(NAN)), name(toName) {}
 
-        Level levelLeft() const {
-            return levelConst;
+        void onPush(Parser &parser) {
+            offset = parser.getOffset();
+            NumToken <T>::onPush(parser);
         }
 
-        Level levelRight() const {
-            return levelFuncR;
+        void onPop(Parser &parser) {
+            BasicCalc <T> &calc = (BasicCalc <T> &) parser;
+
+            // Parameter, when compiling
+            const auto param = calc.paramIndex.find(name);
+            if (param != calc.paramIndex.end()) {
+                calc.program->pushParam(param->second);
+                parser.outStack.push_back(this->shared_from_this());
+                return;
+            }
+
+            const T *found = calc.findConst(name);
+            if (found == nullptr) {
+                parser.fail(ekUnknownName, offset);
+                return;
+            }
+
+            CalcInt intValue;
+            if (intFromExactData(*found, intValue)) {
+                this->setInt(intValue);
+            } else {
+                this->setData(*found);
+            }
+
+            // Differentiation by this name
+            const auto diff = calc.diffIndex.find(name);
+            if (diff != calc.diffIndex.end()) {
+                this->deriv.resize(calc.diffIndex.size(), 0);
+                this->deriv[diff->second] = 1;
+            }
+
+            NumToken <T>::onPop(parser);
         }
 
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkName, tokens.pushText(name));
+            return 1;
+        }
+    };
+
+    // Function of expressions, like integrate(expr, x, a, b)
+    // Compiled and calculated when popped
+    template <class T> class CallToken: public NumToken <T> {
+    protected:
+        CallType type;
+
+        // Arguments as written, and the variable name
+        vector <Input> args;
+        Input name;
+
+        // Offset in the input, for errors
+        size_t offset = 0;
+    public:
+        CallToken(const CallType toType, const vector <Input> &toArgs, const Input &toName):
+            NumToken <T> (T(NAN)), type(toType), args(toArgs), name(toName) {}
+
         void onPush(Parser &parser) {
-            parser.state = stateNum;
+            offset = parser.getOffset();
+            NumToken <T>::onPush(parser);
+        }
+
+        // Number of arguments
+        static size_t argNum(const CallType type) {
+            const size_t toMap[] = {4, 3, 4, 4};
+            return toMap[type];
+        }
+
+        // Position of the body
+        static size_t bodyPos(const CallType type) {
+            const size_t toMap[] = {0, 0, 3, 3};
+            return toMap[type];
+        }
+
+        // Position of the variable name
+        static size_t namePos(const CallType type) {
+            const size_t toMap[] = {1, 1, 0, 0};
+            return toMap[type];
+        }
+
+        // Check if the arguments read a name to differentiate by (other than the variable)
+        // Derivatives of calls are not known
+        bool readsDiff(const BasicCalc <T> &calc) const {
+            for (size_t i = 0; i < args.size(); ++i) {
+                if (i == namePos(type)) {
+                    continue;
+                }
+
+                const Input &arg = args[i];
+                for (InputIter now = arg.begin(); now != arg.end();) {
+                    if (!(charClass(*now) & ccAlpha)) {
+                        ++now;
+                        continue;
+                    }
+
+                    const InputIter begin = now;
+                    now = scanRun(now, arg.end(), ccAlpha | ccDigit);
+                    const Input read(begin, now);
+
+                    if (calc.diffIndex.find(read) != calc.diffIndex.end() && !(i == bodyPos(type) && read == name)) {
+                        return 1;
+                    }
+                }
+            }
+
+            return 0;
+        }
+
+        // Get the variable name from the arguments
+        // Return false if it is not a name
+        static bool getName(const CallType type, const vector <Input> &args, Input &name) {
+            name = "";
+            for (const char c: args[namePos(type)]) {
+                if ((charClass(c) & ccAlpha) || ((charClass(c) & ccDigit) && !name.empty())) {
+                    name += c;
+                } else if (!(charClass(c) & ccBlank)) {
+                    return 0;
+                }
+            }
+
+            return !name.empty() && GetFunc.find(name) == GetFunc.end() && GetCall.find(name) == GetCall.end();
         }
 
         void onPop(Parser &parser) {
-            check(!parser.outStack.empty(), "No operand");
+            BasicCalc <T> &calc = (BasicCalc <T> &) parser;
 
-            // Cast the token
-            // Tokens in outStack should be numbers
-            PNumToken tTarget = dynamic_pointer_cast <NumToken> (
-                parser.outStack.back()
-            );
-            check(tTarget != nullptr, "Unknown operand");
+            // Arguments are functions of the parameters compiling now (if any)
+            BasicCalcProgram <T> local(0);
+            BasicCalcProgram <T> &target = calc.program ? *calc.program : local;
 
-            // Do calculation
+            for (size_t i = 0; i < args.size(); ++i) {
+                if (i == bodyPos(type) || i == namePos(type)) {
+                    continue;
+                }
+
+                const ParseStatus argStatus = calc.compileTo(args[i], calc.paramIndex, target);
+                if (argStatus.kind != ekNone) {
+                    calc.fail(argStatus.kind, offset);
+                    return;
+                }
+            }
+
+            // Body has an extra parameter
+            map <Input, size_t> bodyParams = calc.paramIndex;
+            bodyParams[name] = target.getParamNum();
+
+            PBasicCalcProgram <T> body(new BasicCalcProgram <T> (target.getParamNum() + 1));
+            const ParseStatus bodyStatus = calc.compileTo(args[bodyPos(type)], bodyParams, *body);
+            if (bodyStatus.kind != ekNone) {
+                calc.fail(bodyStatus.kind, offset);
+                return;
+            }
+
+            target.pushCall(type, body);
+
+            // Not run if compiling, or in a branch not taken
+            if (!calc.program && !calc.skipping) {
+                // Fail instead of a wrong derivative of 0
+                if (readsDiff(calc)) {
+                    calc.fail(ekNoDiff, offset);
+                    return;
+                }
+
+                // Long calls stop by the budget, like parsing
+                CalcStopper stop;
+                stop.cancel = calc.cancel;
+                if (calc.budget.maxSeconds > 0) {
+                    stop.timed = 1;
+                    stop.deadline = calc.started + chrono::duration_cast <chrono::steady_clock::duration> (
+                        chrono::duration <double> (calc.budget.maxSeconds)
+                    );
+                }
+
+                this->setData(local.run({}, calc.threads, &stop));
+
+                calc.checkBudget();
+                if (calc.failed()) {
+                    return;
+                }
+            }
+
+            parser.outStack.push_back(this->shared_from_this());
+        }
+
+        bool save(TokenBuffer &tokens) const {
+            for (const auto &item: GetCall) {
+                if (item.second == type) {
+                    tokens.push(tkCall, tokens.pushText(item.first));
+                }
+            }
+            for (const Input &arg: args) {
+                tokens.pushText(arg);
+            }
+            return 1;
+        }
+    };
+
+    // Functions
+    template <class T> class FuncToken: public Token {
+    protected:
+        FuncType type;
+    public:
+        FuncToken(FuncType toType): type(toType) {}
+
+        // Get the derivative at target
+        T diff(const T target) const {
             switch (type) {
             case ftSin:
-                tTarget->value = sin(tTarget->value);
-                break;
+                return cos(target);
             case ftCos:
-                tTarget->value = cos(tTarget->value);
-                break;
+                return -sin(target);
             case ftTan:
-                tTarget->value = tan(tTarget->value);
-                break;
+                return 1 / (cos(target) * cos(target));
             case ftASin:
-                tTarget->value = asin(tTarget->value);
-                break;
+                return 1 / sqrt(1 - target * target);
             case ftACos:
-                tTarget->value = acos(tTarget->value);
-                break;
+                return -1 / sqrt(1 - target * target);
             case ftATan:
-                tTarget->value = atan(tTarget->value);
-                break;
+                return 1 / (1 + target * target);
             case ftSinH:
-                tTarget->value = sinh(tTarget->value);
-                break;
+                return cosh(target);
             case ftCosH:
-                tTarget->value = cosh(tTarget->value);
-                break;
+                return sinh(target);
             case ftTanH:
-                tTarget->value = tanh(tTarget->value);
-                break;
+                return 1 / (cosh(target) * cosh(target));
             case ftASinH:
-                tTarget->value = asinh(tTarget->value);
-                break;
+                return 1 / sqrt(target * target + 1);
             case ftACosH:
-                tTarget->value = acosh(tTarget->value);
-                break;
+                return 1 / sqrt(target * target - 1);
             case ftATanH:
-                tTarget->value = atanh(tTarget->value);
-                break;
+                return 1 / (1 - target * target);
             case ftLog:
-                tTarget->value = log(tTarget->value);
-                break;
+                return 1 / target;
             case ftLog10:
-                tTarget->value = log10(tTarget->value);
-                break;
+                return 1 / (target * log(T(10)));
             case ftLog2:
-                tTarget->value = log2(tTarget->value);
-                break;
+                return 1 / (target * log(T(2)));
             case ftSqr:
-                tTarget->value *= tTarget->value;
-                break;
+                return 2 * target;
             case ftSqrt:
-                tTarget->value = sqrt(tTarget->value);
-                break;
+                return 0.5 / sqrt(target);
             case ftAbs:
-                tTarget->value = abs(tTarget->value);
-                break;
-            case ftSign:
-                tTarget->value = int(tTarget->value > 0) - int(tTarget->value < 0);
-                break;
+                return int(target > 0) - int(target < 0);
             case ftDeg:
-                tTarget->value *= (180 / M_PI);
-                break;
+                return 180 / calcPi <T> ();
             case ftRad:
-                tTarget->value *= (M_PI / 180);
-                break;
+                return calcPi <T> () / 180;
             case ftErf:
-                tTarget->value = erf(tTarget->value);
-                break;
+                return 2 / sqrt(calcPi <T> ()) * exp(-target * target);
             case ftErfc:
-                tTarget->value = erfc(tTarget->value);
-                break;
+                return -2 / sqrt(calcPi <T> ()) * exp(-target * target);
             case ftGamma:
-                tTarget->value = tgamma(tTarget->value);
-                break;
+                return tgamma(target) * digamma(target);
             case ftLGamma:
-                tTarget->value = lgamma(tTarget->value);
-                break;
+                return digamma(target);
+            case ftSign:
             case ftCeil:
-                tTarget->value = ceil(tTarget->value);
-                break;
             case ftFloor:
-                tTarget->value = floor(tTarget->value);
-                break;
             case ftTrunc:
-                tTarget->value = trunc(tTarget->value);
-                break;
             case ftRound:
-                tTarget->value = round(tTarget->value);
-                break;
             case ftInt:
-                tTarget->value = int(tTarget->value);
-                break;
+                // Piecewise constant
+                return 0;
+            }
+
+            // Never reach
+            return T(NAN);
+        }
+
+        Level levelLeft() const {
+            return levelConst;
+        }
+
+        Level levelRight() const {
+            return levelFuncR;
+        }
+
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkFunc, type);
+            return 1;
+        }
+
+        void onPush(Parser &parser) {
+            parser.state = stateNum;
+        }
+
+        void onPop(Parser &parser) {
+            if (parser.outStack.empty()) {
+                parser.fail(ekNoOperand);
+                return;
+            }
+
+            // Cast the token
+            // Tokens in outStack should be numbers
+            PNumToken <T> tTarget = dynamic_pointer_cast <NumToken <T>> (
+                parser.outStack.back()
+            );
+            if (tTarget == nullptr) {
+                parser.fail(ekUnknownOperand);
+                return;
+            }
+
+            // Compile only
+            BasicCalcProgram <T> *program = ((BasicCalc <T> &) parser).program;
+            if (program) {
+                program->pushFunc(type);
+                return;
+            }
+
+            // Check only, in a branch not taken
+            if (((BasicCalc <T> &) parser).skipping) {
+                return;
+            }
+
+            // Do differentiation
+            if (!tTarget->deriv.empty()) {
+                tTarget->chain(diff(tTarget->value));
+            }
+
+            // Do exact calculation
+            if (tTarget->isInt) {
+                CalcInt result;
+
+                switch (type) {
+                case ftSqr:
+                    if (intMul(tTarget->intValue, tTarget->intValue, result)) {
+                        tTarget->setInt(result);
+                        return;
+                    }
+                    break;
+                case ftAbs:
+                    if (intSub(0, tTarget->intValue, result)) {
+                        tTarget->setInt(tTarget->intValue < 0 ? result : tTarget->intValue);
+                        return;
+                    }
+                    break;
+                case ftSign:
+                    tTarget->setInt(int(tTarget->intValue > 0) - int(tTarget->intValue < 0));
+                    return;
+                case ftCeil:
+                case ftFloor:
+                case ftTrunc:
+                case ftRound:
+                case ftInt:
+                    return;
+                default:
+                    break;
+                }
+            }
+
+            // Do calculation
+            tTarget->isInt = 0;
+            tTarget->value = calcFunc(type, tTarget->value);
+
+            // Integer conversion gives exact result
+            if (type == ftInt) {
+                CalcInt result;
+
+                if (intFromData(tTarget->value, result)) {
+                    tTarget->setInt(result);
+                }
             }
         }
     };
 
     // Assignation (reference)
-    class AssignToken: public Token {
+    template <class T> class AssignToken: public Token {
     protected:
         Input name;
     public:
-        AssignToken(Input &toName): name(toName) {}
+        AssignToken(const Input &toName): name(toName) {}
 
         Level levelLeft() const {
             return levelFlushAll;
@@ -194,35 +613,437 @@ namespace OPParser {
         }
 
         void onPop(Parser &parser) {
-            check(!parser.outStack.empty(), "No operand");
+            if (parser.outStack.empty()) {
+                parser.fail(ekNoOperand);
+                return;
+            }
 
             // Cast the token
             // Tokens in outStack should be numbers
-            PNumToken tTarget = dynamic_pointer_cast <NumToken> (
+            PNumToken <T> tTarget = dynamic_pointer_cast <NumToken <T>> (
+                parser.outStack.back()
+            );
+            if (tTarget == nullptr) {
+                parser.fail(ekUnknownOperand);
+                return;
+            }
+            if (((BasicCalc <T> &) parser).program != nullptr) {
+                parser.fail(ekAssignCompiling);
+                return;
+            }
+
+            // Check only, in a branch not taken
+            if (((BasicCalc <T> &) parser).skipping) {
+                return;
+            }
+
+            // Do assignation
+            (*((BasicCalc <T> &) parser).consts)[name] = tTarget->value;
+        }
+
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkAssign, tokens.pushText(name));
+            return 1;
+        }
+    };
+
+    // Bi-operators
+    template <class T> class BiToken: public Token {
+    protected:
+        BiOperType type;
+
+        // && and ||: the right operand is not calculated
+        bool skipRight = 0;
+
+        // && and ||: operation of the condition (if compiling), then of the jump
+        size_t index = 0;
+    public:
+        BiToken(BiOperType toType): type(toType) {}
+
+        // Apply the derivatives of both operands to the left one
+        void diff(NumToken <T> &left, const NumToken <T> &right) const {
+            const T l = left.value;
+            const T r = right.value;
+
+            if (left.deriv.size() < right.deriv.size()) {
+                left.deriv.resize(right.deriv.size(), 0);
+            }
+
+            for (size_t i = 0; i < left.deriv.size(); ++i) {
+                T &dl = left.deriv[i];
+                const T dr = i < right.deriv.size() ? right.deriv[i] : 0;
+
+                switch (type) {
+                case otAdd:
+                    dl += dr;
+                    break;
+                case otSub:
+                    dl -= dr;
+                    break;
+                case otMul:
+                case otIMul:
+                    dl = dl * r + l * dr;
+                    break;
+                case otDiv:
+                    dl = (dl * r - l * dr) / (r * r);
+                    break;
+                case otMod:
+                    dl -= trunc(l / r) * dr;
+                    break;
+                case otPwr:
+                    // Skip the log term if the exponent is constant, as l may be negative
+                    dl = (dl == 0 ? 0 : r * pow(l, r - 1) * dl)
+                         + (dr == 0 ? 0 : pow(l, r) * log(l) * dr);
+                    break;
+                default:
+                    // Piecewise constant
+                    dl = 0;
+                    break;
+                }
+            }
+        }
+
+        // Start the right operand of && and ||, after the left one is calculated
+        // Skip it if the left one decides the result
+        void onPushed(Parser &parser) {
+            if (type != otAnd && type != otOr) {
+                return;
+            }
+
+            BasicCalc <T> &calc = (BasicCalc <T> &) parser;
+
+            // a && b is a ? b != 0 : 0, a || b is a ? 1 : b != 0
+            if (calc.program) {
+                index = calc.program->pushCond();
+                if (type == otOr) {
+                    calc.program->pushNum(1);
+                    index = calc.program->pushElse(index);
+                }
+                return;
+            }
+
+            // Skipped already, or checked when popped
+            if (calc.skipping || parser.outStack.empty()) {
+                return;
+            }
+
+            PNumToken <T> tLeft = dynamic_pointer_cast <NumToken <T>> (
+                parser.outStack.back()
+            );
+            if (tLeft != nullptr && (tLeft->value != 0) == (type == otOr)) {
+                skipRight = 1;
+                ++calc.skipping;
+            }
+        }
+
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkBi, type);
+            return 1;
+        }
+
+        Level levelLeft() const {
+            const Level toMap[] = {
+                levelAddSubL, levelAddSubL, levelMulDivL, levelIMulL, levelMulDivL, levelMulDivL, levelPwrL,
+                levelLessL, levelLessL, levelLessL, levelLessL, levelEqualL, levelEqualL, levelAndL, levelOrL
+            };
+            return toMap[type];
+        }
+
+        Level levelRight() const {
+            const Level toMap[] = {
+                levelAddSubR, levelAddSubR, levelMulDivR, levelIMulR, levelMulDivR, levelMulDivR, levelPwrR,
+                levelLessR, levelLessR, levelLessR, levelLessR, levelEqualR, levelEqualR, levelAndR, levelOrR
+            };
+            return toMap[type];
+        }
+
+        void onPush(Parser &parser) {
+            parser.state = stateNum;
+        }
+
+        void onPop(Parser &parser) {
+            if (parser.outStack.size() < 2) {
+                parser.fail(ekNoOperand);
+                return;
+            }
+
+            // Cast the tokens
+            // Tokens in outStack should be numbers
+            PNumToken <T> tRight = dynamic_pointer_cast <NumToken <T>> (
+                parser.outStack.back()
+            );
+            parser.outStack.pop_back();
+            PNumToken <T> tLeft = dynamic_pointer_cast <NumToken <T>> (
+                parser.outStack.back()
+            );
+
+            if (tRight == nullptr || tLeft == nullptr) {
+                parser.fail(ekUnknownOperand);
+                return;
+            }
+
+            // Compile only
+            BasicCalcProgram <T> *program = ((BasicCalc <T> &) parser).program;
+            if (program) {
+                switch (type) {
+                case otAnd:
+                    program->pushNum(0);
+                    program->pushBi(otNotEqual);
+                    index = program->pushElse(index);
+                    program->pushNum(0);
+                    program->pushSelect(index);
+                    break;
+                case otOr:
+                    program->pushNum(0);
+                    program->pushBi(otNotEqual);
+                    program->pushSelect(index);
+                    break;
+                default:
+                    program->pushBi(type);
+                    break;
+                }
+                return;
+            }
+
+            // The left operand decides
+            if (skipRight) {
+                --((BasicCalc <T> &) parser).skipping;
+                tLeft->chain(0);
+                tLeft->setInt(type == otOr);
+                return;
+            }
+
+            // Check only, in a branch not taken
+            if (((BasicCalc <T> &) parser).skipping) {
+                return;
+            }
+
+            // Do differentiation
+            if (!tLeft->deriv.empty() || !tRight->deriv.empty()) {
+                diff(*tLeft, *tRight);
+            }
+
+            // Do exact calculation
+            // If overflow, fall back
+            if (tLeft->isInt && tRight->isInt) {
+                CalcInt result;
+                bool done = 0;
+
+                switch (type) {
+                case otAdd:
+                    done = intAdd(tLeft->intValue, tRight->intValue, result);
+                    break;
+                case otSub:
+                    done = intSub(tLeft->intValue, tRight->intValue, result);
+                    break;
+                case otMul:
+                case otIMul:
+                    done = intMul(tLeft->intValue, tRight->intValue, result);
+                    break;
+                case otDiv:
+                    break;
+                case otMod:
+                    done = intMod(tLeft->intValue, tRight->intValue, result);
+                    break;
+                case otPwr:
+                    done = intPwr(tLeft->intValue, tRight->intValue, result);
+                    break;
+                case otLess:
+                    result = tLeft->intValue < tRight->intValue;
+                    done = 1;
+                    break;
+                case otLessEq:
+                    result = tLeft->intValue <= tRight->intValue;
+                    done = 1;
+                    break;
+                case otGreater:
+                    result = tLeft->intValue > tRight->intValue;
+                    done = 1;
+                    break;
+                case otGreaterEq:
+                    result = tLeft->intValue >= tRight->intValue;
+                    done = 1;
+                    break;
+                case otEqual:
+                    result = tLeft->intValue == tRight->intValue;
+                    done = 1;
+                    break;
+                case otNotEqual:
+                    result = tLeft->intValue != tRight->intValue;
+                    done = 1;
+                    break;
+                case otAnd:
+                    result = tLeft->intValue != 0 && tRight->intValue != 0;
+                    done = 1;
+                    break;
+                case otOr:
+                    result = tLeft->intValue != 0 || tRight->intValue != 0;
+                    done = 1;
+                    break;
+                }
+
+                if (done) {
+                    tLeft->setInt(result);
+                    return;
+                }
+            }
+
+            // Do calculation
+            tLeft->isInt = 0;
+            tLeft->value = calcBi(type, tLeft->value, tRight->value);
+
+            // Comparisons give exact 0 or 1
+            if (type >= otLess) {
+                tLeft->setInt(CalcInt(tLeft->value));
+            }
+        }
+    };
+
+    // Mono-operators
+    template <class T> class MonoToken: public Token {
+    protected:
+        MonoOperType type;
+    public:
+        MonoToken(MonoOperType toType): type(toType) {}
+
+        Level levelLeft() const {
+            const Level toMap[] = {levelConst, levelConst, levelFacL};
+            return toMap[type];
+        }
+
+        Level levelRight() const {
+            const Level toMap[] = {levelAddSubR, levelAddSubR, levelConst};
+            return toMap[type];
+        }
+
+        void onPush(Parser &parser) {
+            const State toMap[] = {stateNum, stateNum, stateOper};
+            parser.state = toMap[type];
+        }
+
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkMono, type);
+            return 1;
+        }
+
+        void onPop(Parser &parser) {
+            if (parser.outStack.empty()) {
+                parser.fail(ekNoOperand);
+                return;
+            }
+
+            // Cast the token
+            // Tokens in outStack should be numbers
+            PNumToken <T> tTarget = dynamic_pointer_cast <NumToken <T>> (
+                parser.outStack.back()
+            );
+            if (tTarget == nullptr) {
+                parser.fail(ekUnknownOperand);
+                return;
+            }
+
+            // Compile only
+            BasicCalcProgram <T> *program = ((BasicCalc <T> &) parser).program;
+            if (program) {
+                program->pushMono(type);
+                return;
+            }
+
+            // Check only, in a branch not taken
+            if (((BasicCalc <T> &) parser).skipping) {
+                return;
+            }
+
+            // Do differentiation
+            if (!tTarget->deriv.empty()) {
+                switch (type) {
+                case mtPos:
+                    break;
+                case mtNeg:
+                    tTarget->chain(-1);
+                    break;
+                case mtFac:
+                    tTarget->chain(tgamma(tTarget->value + 1) * digamma(tTarget->value + 1));
+                    break;
+                }
+            }
+
+            // Do exact calculation
+            if (tTarget->isInt) {
+                CalcInt result;
+
+                switch (type) {
+                case mtPos:
+                    return;
+                case mtNeg:
+                    if (intSub(0, tTarget->intValue, result)) {
+                        tTarget->setInt(result);
+                        return;
+                    }
+                    break;
+                case mtFac:
+                    if (intFac(tTarget->intValue, result)) {
+                        tTarget->setInt(result);
+                        return;
+                    }
+                    break;
+                }
+            }
+
+            // Do calculation
+            tTarget->isInt = 0;
+            tTarget->value = calcMono(type, tTarget->value);
+        }
+    };
+
+    // Conditional, "?" of "cond ? a : b"
+    // Like a left bracket of the branches
+    template <class T> class CondToken: public Token {
+    protected:
+        // Branches not calculated
+        bool skipFirst = 0;
+        bool skipSecond = 0;
+
+        // Operation of the condition (if compiling), then of the jump
+        size_t index = 0;
+    public:
+        friend class ElseToken <T>;
+
+        // Start the first branch, after the condition is calculated
+        // Skip the branch not taken
+        void onPushed(Parser &parser) {
+            BasicCalc <T> &calc = (BasicCalc <T> &) parser;
+
+            if (calc.program) {
+                index = calc.program->pushCond();
+                return;
+            }
+
+            // Skipped already, or checked when the branches end
+            if (calc.skipping || parser.outStack.empty()) {
+                return;
+            }
+
+            PNumToken <T> tCond = dynamic_pointer_cast <NumToken <T>> (
                 parser.outStack.back()
             );
-            check(tTarget != nullptr, "Unknown operand");
+            if (tCond == nullptr) {
+                return;
+            }
 
-            // Do assignation
-            GetConst[name] = tTarget->value;
+            skipFirst = tCond->value == 0;
+            skipSecond = !skipFirst;
+            if (skipFirst) {
+                ++calc.skipping;
+            }
         }
-    };
-
-    // Bi-operators
-    class BiToken: public Token {
-    protected:
-        BiOperType type;
-    public:
-        BiToken(BiOperType toType): type(toType) {}
 
         Level levelLeft() const {
-            const Level toMap[] = {levelAddSubL, levelAddSubL, levelMulDivL, levelIMulL, levelMulDivL, levelMulDivL, levelPwrL};
-            return toMap[type];
+            return levelCondL;
         }
 
         Level levelRight() const {
-            const Level toMap[] = {levelAddSubR, levelAddSubR, levelMulDivR, levelIMulR, levelMulDivR, levelMulDivR, levelPwrR};
-            return toMap[type];
+            return levelCondR;
         }
 
         void onPush(Parser &parser) {
@@ -230,90 +1051,109 @@ namespace OPParser {
         }
 
         void onPop(Parser &parser) {
-            check(parser.outStack.size() >= 2, "No operand");
-
-            // Cast the tokens
-            // Tokens in outStack should be numbers
-            PNumToken tRight = dynamic_pointer_cast <NumToken> (
-                parser.outStack.back()
-            );
-            parser.outStack.pop_back();
-            PNumToken tLeft = dynamic_pointer_cast <NumToken> (
-                parser.outStack.back()
-            );
-
-            check(tRight != nullptr && tLeft != nullptr, "Unknown operand");
+            // Popped by ElseToken if ":" is found
+            parser.fail(ekNoElse);
+        }
 
-            // Do calculation
-            switch (type) {
-            case otAdd:
-                tLeft->value += tRight->value;
-                break;
-            case otSub:
-                tLeft->value -= tRight->value;
-                break;
-            case otMul:
-            case otIMul:
-                tLeft->value *= tRight->value;
-                break;
-            case otDiv:
-                tLeft->value /= tRight->value;
-                break;
-            case otMod:
-                tLeft->value -= int(tLeft->value / tRight->value) * tRight->value;
-                break;
-            case otPwr:
-                tLeft->value = pow(tLeft->value, tRight->value);
-                break;
-            }
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkCond, 0);
+            return 1;
         }
     };
 
-    // Mono-operators
-    class MonoToken: public Token {
-    protected:
-        MonoOperType type;
+    // Conditional, ":" of "cond ? a : b"
+    template <class T> class ElseToken: public Token {
     public:
-        MonoToken(MonoOperType toType): type(toType) {}
+        // Start the second branch, after the first one is calculated
+        void onPushed(Parser &parser) {
+            // Pushed right after the "?"
+            PCondToken <T> tCond(nullptr);
+            if (parser.midStack.size() >= 2) {
+                tCond = dynamic_pointer_cast <CondToken <T>> (
+                    parser.midStack[parser.midStack.size() - 2]
+                );
+            }
+            if (tCond == nullptr) {
+                parser.fail(ekNoCond);
+                return;
+            }
+
+            BasicCalc <T> &calc = (BasicCalc <T> &) parser;
+
+            if (calc.program) {
+                tCond->index = calc.program->pushElse(tCond->index);
+                return;
+            }
+
+            if (tCond->skipFirst) {
+                --calc.skipping;
+            }
+            if (tCond->skipSecond) {
+                ++calc.skipping;
+            }
+        }
 
         Level levelLeft() const {
-            const Level toMap[] = {levelConst, levelConst, levelFacL};
-            return toMap[type];
+            return levelElseL;
         }
 
         Level levelRight() const {
-            const Level toMap[] = {levelAddSubR, levelAddSubR, levelConst};
-            return toMap[type];
+            return levelElseR;
         }
 
         void onPush(Parser &parser) {
-            const State toMap[] = {stateNum, stateNum, stateOper};
-            parser.state = toMap[type];
+            parser.state = stateNum;
         }
 
         void onPop(Parser &parser) {
-            check(!parser.outStack.empty(), "No operand");
+            // Cast the token to "?", then delete it
+            PCondToken <T> tCond(nullptr);
+            if (!parser.midStack.empty()) {
+                tCond = dynamic_pointer_cast <CondToken <T>> (
+                    parser.midStack.back()
+                );
+            }
+            if (tCond == nullptr) {
+                parser.fail(ekNoCond);
+                return;
+            }
+            parser.midStack.pop_back();
 
-            // Cast the token
-            // Tokens in outStack should be numbers
-            PNumToken tTarget = dynamic_pointer_cast <NumToken> (
-                parser.outStack.back()
-            );
-            check(tTarget != nullptr, "Unknown operand");
+            if (parser.outStack.size() < 3) {
+                parser.fail(ekNoOperand);
+                return;
+            }
 
-            // Do calculation
-            switch (type) {
-            case mtPos:
-                // tTarget->value = +tTarget->value;
-                break;
-            case mtNeg:
-                tTarget->value = -tTarget->value;
-                break;
-            case mtFac:
-                // x! == gamma(x + 1)
-                tTarget->value = tgamma(tTarget->value + 1);
-                break;
+            // Condition and branches
+            const PToken tSecond = parser.outStack.back();
+            parser.outStack.pop_back();
+            const PToken tFirst = parser.outStack.back();
+            parser.outStack.pop_back();
+
+            BasicCalc <T> &calc = (BasicCalc <T> &) parser;
+
+            // Compile only
+            if (calc.program) {
+                calc.program->pushSelect(tCond->index);
+                parser.outStack.back() = PToken(new ParamToken <T> ());
+                return;
+            }
+
+            if (tCond->skipSecond) {
+                --calc.skipping;
+            }
+
+            // Check only, in a branch not taken
+            if (calc.skipping) {
+                return;
             }
+
+            parser.outStack.back() = tCond->skipFirst ? tSecond : tFirst;
+        }
+
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkElse, 0);
+            return 1;
         }
     };
 
@@ -334,6 +1174,11 @@ namespace OPParser {
 
         void onPop(Parser &parser) {
         }
+
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkLeft, 0);
+            return 1;
+        }
     };
 
     // Right bracket
@@ -352,27 +1197,36 @@ namespace OPParser {
         }
 
         void onPop(Parser &parser) {
-            check(!parser.midStack.empty(), "No left bracket");
+            if (parser.midStack.empty()) {
+                parser.fail(ekNoLeftBracket);
+                return;
+            }
 
             // Cast the token to left bracket, then delete it
             PLeftToken tLB = dynamic_pointer_cast <LeftToken> (
                 parser.midStack.back()
             );
-            check(tLB != nullptr, "Bad left bracket");
+            if (tLB == nullptr) {
+                parser.fail(ekBadLeftBracket);
+                return;
+            }
 
             parser.midPop();
         }
+
+        bool save(TokenBuffer &tokens) const {
+            tokens.push(tkRight, 0);
+            return 1;
+        }
     };
 
     // Lexers
 
     // Numbers
-    class NumLexer: public Lexer {
+    template <class T> class NumLexer: public Lexer {
     public:
         bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
-            Input buffer = "";
-
-            if ((*now >= '0' && *now <= '9') || *now == '.') {
+            if (charClass(*now) & (ccDigit | ccDot)) {
                 // Accepted
             } else {
                 // Not a number
@@ -380,34 +1234,102 @@ namespace OPParser {
             }
 
             // Read number to buffer
-            for (; now != end; ++now) {
-                if ((*now >= '0' && *now <= '9') || *now == '.') {
-                    buffer += *now;
-                } else {
-                    break;
-                }
-            }
+            const InputIter begin = now;
+            now = scanRun(now, end, ccDigit | ccDot);
+            const Input buffer(begin, now);
 
             // Generate token
 
             char *endPtr;
-            CalcData number = strtod(buffer.c_str(), &endPtr);
+            PToken token(nullptr);
+
+            // Integer literal
+            if (buffer.find('.') == Input::npos) {
+                errno = 0;
+                CalcInt number = strtoll(buffer.c_str(), &endPtr, 10);
+
+                if (errno != ERANGE) {
+                    token = PToken(new NumToken <T> (number));
+                }
+            }
 
-            check(*endPtr == 0, "Wrong format of number");
+            // Real literal, or integer out of range
+            if (token == nullptr) {
+                T number;
+                calcFromString(buffer.c_str(), &endPtr, number);
+
+                if (*endPtr != 0) {
+                    parser.fail(ekBadNumber);
+                    return 1;
+                }
+
+                token = PToken(new NumToken <T> (number));
+            }
 
-            PToken token(new NumToken(number));
             parser.midPush(token);
             return 1;
         }
     };
 
     // Functions and constants
-    class NameLexer: public Lexer {
+    template <class T> class NameLexer: public Lexer {
+    protected:
+        // Read arguments like "(expr, x, a, b)" or "(i, a, b, expr)" and generate the call
+        // Return nullptr if failed
+        PToken getCall(const CallType type, InputIter &now, const InputIter &end, BasicCalc <T> &calc) {
+            // Skip blank, like BlankLexer
+            now = scanRun(now, end, ccBlank);
+
+            if (now == end || *now != '(') {
+                calc.fail(ekNoLeftBracket);
+                return nullptr;
+            }
+
+            // Split arguments by top-level commas
+            vector <Input> args = {""};
+            int depth = 0;
+            for (; now != end; ++now) {
+                if (*now == '(') {
+                    ++depth;
+                    if (depth == 1) {
+                        continue;
+                    }
+                } else if (*now == ')') {
+                    --depth;
+                    if (depth == 0) {
+                        break;
+                    }
+                } else if (*now == ',' && depth == 1) {
+                    args.push_back("");
+                    continue;
+                }
+
+                args.back() += *now;
+            }
+
+            if (now == end) {
+                calc.fail(ekNoRightBracket);
+                return nullptr;
+            }
+            ++now;
+
+            if (args.size() != CallToken <T>::argNum(type)) {
+                calc.fail(ekBadArgumentNum);
+                return nullptr;
+            }
+
+            // Get the variable name
+            Input name;
+            if (!CallToken <T>::getName(type, args, name)) {
+                calc.fail(ekBadVariable);
+                return nullptr;
+            }
+
+            return PToken(new CallToken <T> (type, args, name));
+        }
     public:
         bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
-            Input buffer = "";
-
-            if ((*now >= 'A' && *now <= 'Z') || (*now >= 'a' && *now <= 'z') || *now == '_') {
+            if (charClass(*now) & ccAlpha) {
                 // Accepted
             } else {
                 // Not a name
@@ -415,23 +1337,27 @@ namespace OPParser {
             }
 
             // Read name to buffer
-            for (; now != end; ++now) {
-                if ((*now >= 'A' && *now <= 'Z') || (*now >= 'a' && *now <= 'z') || *now == '_' || (*now >= '0' && *now <= '9')) {
-                    buffer += *now;
-                } else {
-                    break;
-                }
-            }
+            const InputIter begin = now;
+            now = scanRun(now, end, ccAlpha | ccDigit);
+            const Input buffer(begin, now);
 
             // Generate token
 
+            BasicCalc <T> &calc = (BasicCalc <T> &) parser;
+
             PToken token(nullptr);
-            if (GetFunc.find(buffer) != GetFunc.end()) {
-                token = PToken(new FuncToken(GetFunc[buffer]));
-            } else if (GetConst.find(buffer) != GetConst.end()) {
-                token = PToken(new NumToken(GetConst[buffer]));
+            const auto call = GetCall.find(buffer);
+            const auto func = GetFunc.find(buffer);
+            if (call != GetCall.end()) {
+                token = getCall(call->second, now, end, calc);
+                if (token == nullptr) {
+                    return 1;
+                }
+            } else if (func != GetFunc.end()) {
+                token = PToken(new FuncToken <T> (func->second));
             } else {
-                error("Unknown function or constant");
+                // Parameters, constants and variables are looked up when popped
+                token = PToken(new NameToken <T> (buffer));
             }
 
             parser.midPush(token);
@@ -440,12 +1366,10 @@ namespace OPParser {
     };
 
     // Constants reference (for assignation)
-    class NameRefLexer: public Lexer {
+    template <class T> class NameRefLexer: public Lexer {
     public:
         bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
-            Input buffer = "";
-
-            if ((*now >= 'A' && *now <= 'Z') || (*now >= 'a' && *now <= 'z') || *now == '_') {
+            if (charClass(*now) & ccAlpha) {
                 // Accepted
             } else {
                 // Not a name
@@ -453,19 +1377,18 @@ namespace OPParser {
             }
 
             // Read name to buffer
-            for (; now != end; ++now) {
-                if ((*now >= 'A' && *now <= 'Z') || (*now >= 'a' && *now <= 'z') || *now == '_' || (*now >= '0' && *now <= '9')) {
-                    buffer += *now;
-                } else {
-                    break;
-                }
-            }
+            const InputIter begin = now;
+            now = scanRun(now, end, ccAlpha | ccDigit);
+            const Input buffer(begin, now);
 
             // Generate token
 
-            PToken token(new AssignToken(buffer));
+            if (GetFunc.find(buffer) != GetFunc.end() || GetCall.find(buffer) != GetCall.end()) {
+                parser.fail(ekAssignFunction);
+                return 1;
+            }
 
-            check(GetFunc.find(buffer) == GetFunc.end(), "Can not assign to a function");
+            PToken token(new AssignToken <T> (buffer));
 
             parser.midPush(token);
             return 1;
@@ -490,39 +1413,105 @@ namespace OPParser {
     };
 
     // Operators appear after number
-    class AfterNumLexer: public Lexer {
+    template <class T> class AfterNumLexer: public Lexer {
     public:
         bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
             PToken token(nullptr);
 
+            // Length of the operator
+            int length = 1;
+            const char next = now + 1 != end ? *(now + 1) : 0;
+
             // Cast and recognise token
             switch (*now) {
             case '+':
-                token = PToken(new BiToken(otAdd));
+                token = PToken(new BiToken <T> (otAdd));
                 break;
             case '-':
-                token = PToken(new BiToken(otSub));
+                token = PToken(new BiToken <T> (otSub));
                 break;
             case '*':
-                token = PToken(new BiToken(otMul));
+                token = PToken(new BiToken <T> (otMul));
                 break;
             case '/':
-                token = PToken(new BiToken(otDiv));
+                token = PToken(new BiToken <T> (otDiv));
                 break;
             case '%':
-                token = PToken(new BiToken(otMod));
+                token = PToken(new BiToken <T> (otMod));
                 break;
             case '^':
-                token = PToken(new BiToken(otPwr));
+                token = PToken(new BiToken <T> (otPwr));
                 break;
             case '!':
-                token = PToken(new MonoToken(mtFac));
+                if (next == '=') {
+                    token = PToken(new BiToken <T> (otNotEqual));
+                    length = 2;
+                } else {
+                    token = PToken(new MonoToken <T> (mtFac));
+                }
+                break;
+            case '<':
+                if (next == '=') {
+                    token = PToken(new BiToken <T> (otLessEq));
+                    length = 2;
+                } else {
+                    token = PToken(new BiToken <T> (otLess));
+                }
+                break;
+            case '>':
+                if (next == '=') {
+                    token = PToken(new BiToken <T> (otGreaterEq));
+                    length = 2;
+                } else {
+                    token = PToken(new BiToken <T> (otGreater));
+                }
+                break;
+            case '=':
+                if (next == '=') {
+                    token = PToken(new BiToken <T> (otEqual));
+                    length = 2;
+                }
+                break;
+            case '&':
+                if (next == '&') {
+                    token = PToken(new BiToken <T> (otAnd));
+                    length = 2;
+                }
+                break;
+            case '|':
+                if (next == '|') {
+                    token = PToken(new BiToken <T> (otOr));
+                    length = 2;
+                }
                 break;
             }
 
             if (token != nullptr) {
+                // Accepted
+                now += length;
+                parser.midPush(token);
+                return 1;
+            } else {
+                return 0;
+            }
+        }
+    };
+
+    // Conditionals
+    // cond ? a : b
+    template <class T> class CondLexer: public Lexer {
+    public:
+        bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
+            if (*now == '?') {
+                // Accepted
+                ++now;
+                PToken token(new CondToken <T> ());
+                parser.midPush(token);
+                return 1;
+            } else if (*now == ':') {
                 // Accepted
                 ++now;
+                PToken token(new ElseToken <T> ());
                 parser.midPush(token);
                 return 1;
             } else {
@@ -532,7 +1521,7 @@ namespace OPParser {
     };
 
     // Operators appear without number before
-    class NoNumLexer: public Lexer {
+    template <class T> class NoNumLexer: public Lexer {
     public:
         bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
             PToken token(nullptr);
@@ -540,10 +1529,10 @@ namespace OPParser {
             // Cast and recognise token
             switch (*now) {
             case '+':
-                token = PToken(new MonoToken(mtPos));
+                token = PToken(new MonoToken <T> (mtPos));
                 break;
             case '-':
-                token = PToken(new MonoToken(mtNeg));
+                token = PToken(new MonoToken <T> (mtNeg));
                 break;
             }
 
@@ -594,15 +1583,11 @@ namespace OPParser {
     class BlankLexer: public Lexer {
     public:
         bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
-            switch (*now) {
-            case 0:
-            case '\t':
-            case '\n':
-            case '\r':
-            case ' ':
-                ++now;
+            if (charClass(*now) & ccBlank) {
+                // Skip all blank
+                now = scanRun(now, end, ccBlank);
                 return 1;
-            default:
+            } else {
                 return 0;
             }
         }
@@ -611,78 +1596,398 @@ namespace OPParser {
     // Implicit multiplication
     // Like "3 pi = 3 * pi"
     // Should be the last one in the lexers chain
-    class ImplicitMulLexer: public Lexer {
+    template <class T> class ImplicitMulLexer: public Lexer {
     public:
         bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
-            PToken token(new BiToken(otIMul));
+            PToken token(new BiToken <T> (otIMul));
             parser.midPush(token);
             return 1;
         }
     };
 
-    void Calc::addFirstLexers() {
+    template <class T> void BasicCalc <T>::addFirstLexers(LexerMap &target) {
         {
-            PLexer lexer(new NumLexer());
-            lexers[stateNum].push_back(lexer);
+            PLexer lexer(new NumLexer <T> ());
+            target[stateNum].push_back(lexer);
         }
         {
-            PLexer lexer(new NameLexer());
-            lexers[stateNum].push_back(lexer);
+            PLexer lexer(new NameLexer <T> ());
+            target[stateNum].push_back(lexer);
         }
         {
-            PLexer lexer(new NameRefLexer());
-            lexers[stateAssign].push_back(lexer);
+            PLexer lexer(new NameRefLexer <T> ());
+            target[stateAssign].push_back(lexer);
         }
         {
             PLexer lexer(new AssignLexer());
-            lexers[stateOper].push_back(lexer);
+            target[stateOper].push_back(lexer);
         }
         {
-            PLexer lexer(new AfterNumLexer());
-            lexers[stateOper].push_back(lexer);
+            PLexer lexer(new AfterNumLexer <T> ());
+            target[stateOper].push_back(lexer);
         }
         {
-            PLexer lexer(new NoNumLexer());
-            lexers[stateNum].push_back(lexer);
+            PLexer lexer(new CondLexer <T> ());
+            target[stateOper].push_back(lexer);
+        }
+        {
+            PLexer lexer(new NoNumLexer <T> ());
+            target[stateNum].push_back(lexer);
         }
         {
             PLexer lexer(new LeftLexer());
-            lexers[stateNum].push_back(lexer);
+            target[stateNum].push_back(lexer);
         }
         {
             PLexer lexer(new RightLexer());
-            lexers[stateOper].push_back(lexer);
+            target[stateOper].push_back(lexer);
         }
     }
 
-    void Calc::addLastLexers() {
+    template <class T> void BasicCalc <T>::addLastLexers(LexerMap &target) {
         {
             PLexer lexer(new BlankLexer());
-            lexers[stateNum].push_back(lexer);
-            lexers[stateOper].push_back(lexer);
-            lexers[stateAssign].push_back(lexer);
+            target[stateNum].push_back(lexer);
+            target[stateOper].push_back(lexer);
+            target[stateAssign].push_back(lexer);
         }
         {
-            PLexer lexer(new ImplicitMulLexer());
-            lexers[stateOper].push_back(lexer);
+            PLexer lexer(new ImplicitMulLexer <T> ());
+            target[stateOper].push_back(lexer);
+        }
+    }
+
+    template <class T> PToken BasicCalc <T>::loadToken(const TokenBuffer &tokens, const size_t index) const {
+        const uint64_t payload = tokens.payloads[index];
+
+        // Payload is the index of n texts
+        auto hasTexts = [&](const size_t n) {
+            return payload < tokens.texts.size() && tokens.texts.size() - payload >= n;
+        };
+
+        switch (tokens.kinds[index]) {
+        case tkInt:
+            return PToken(new NumToken <T> (CalcInt(payload)));
+        case tkReal:
+            if (hasTexts(1) && tokens.texts[payload].size() == sizeof(T)) {
+                T value;
+                memcpy(&value, tokens.texts[payload].data(), sizeof(T));
+                return PToken(new NumToken <T> (value));
+            }
+            break;
+        case tkName:
+            if (hasTexts(1)) {
+                return PToken(new NameToken <T> (tokens.texts[payload]));
+            }
+            break;
+        case tkCall:
+            if (hasTexts(1) && GetCall.find(tokens.texts[payload]) != GetCall.end()) {
+                const CallType type = GetCall.at(tokens.texts[payload]);
+                const size_t argNum = CallToken <T>::argNum(type);
+
+                if (hasTexts(1 + argNum)) {
+                    const vector <Input> args(
+                        tokens.texts.begin() + payload + 1, tokens.texts.begin() + payload + 1 + argNum
+                    );
+
+                    Input name;
+                    if (CallToken <T>::getName(type, args, name)) {
+                        return PToken(new CallToken <T> (type, args, name));
+                    }
+                }
+            }
+            break;
+        case tkFunc:
+            if (payload <= ftInt) {
+                return PToken(new FuncToken <T> (FuncType(payload)));
+            }
+            break;
+        case tkAssign:
+            if (hasTexts(1)) {
+                return PToken(new AssignToken <T> (tokens.texts[payload]));
+            }
+            break;
+        case tkBi:
+            if (payload <= otOr) {
+                return PToken(new BiToken <T> (BiOperType(payload)));
+            }
+            break;
+        case tkMono:
+            if (payload <= mtFac) {
+                return PToken(new MonoToken <T> (MonoOperType(payload)));
+            }
+            break;
+        case tkCond:
+            return PToken(new CondToken <T> ());
+        case tkElse:
+            return PToken(new ElseToken <T> ());
+        case tkLeft:
+            return PToken(new LeftToken());
+        case tkRight:
+            return PToken(new RightToken());
+        }
+
+        return nullptr;
+    }
+
+    template <class T> ParseStatus BasicCalc <T>::compileTo(const Input &input, const map <Input, size_t> &params, BasicCalcProgram <T> &target) const {
+        BasicCalc <T> calc;
+        calc.init();
+        calc.consts = consts;
+        calc.layers = layers;
+        calc.budget = budget;
+        calc.cancel = cancel;
+        calc.paramIndex = params;
+        calc.program = &target;
+
+        calc.tryParse(input);
+
+        vector <PToken> result;
+        ParseStatus finalStatus = calc.tryFinish(result);
+
+        if (finalStatus.kind == ekNone && result.size() != 1) {
+            finalStatus.kind = ekBadArgument;
+        }
+        return finalStatus;
+    }
+
+    template <class T> PBasicCalcProgram <T> BasicCalc <T>::compile(const Input &input, const vector <Input> &params) const {
+        map <Input, size_t> toParams;
+        for (size_t i = 0; i < params.size(); ++i) {
+            toParams[params[i]] = i;
+        }
+
+        PBasicCalcProgram <T> result(new BasicCalcProgram <T> (params.size()));
+
+        const ParseStatus finalStatus = compileTo(input, toParams, *result);
+        if (finalStatus.kind != ekNone) {
+            error(errorInfo(finalStatus.kind));
+        }
+
+        return result;
+    }
+
+    template <class T> void BasicCalc <T>::reset() {
+        Parser::reset();
+        skipping = 0;
+    }
+
+    template <class T> void BasicCalc <T>::freeze() {
+        if (consts != &own) {
+            // Not own (shared with other calculators), copy once
+            own = *consts;
+            consts = &own;
+        }
+
+        if (own.empty() && layers != nullptr) {
+            return;
+        }
+
+        shared_ptr <CalcLayer <T> > layer(new CalcLayer <T> ());
+        if (layers != nullptr && layers->depth >= 32) {
+            // Merge layers when deep, to keep lookups short
+            layer->values = allConsts();
+            layer->depth = 1;
+        } else {
+            layer->values.swap(own);
+            layer->parent = layers;
+            layer->depth = layers != nullptr ? layers->depth + 1 : 1;
+        }
+
+        own.clear();
+        layers = layer;
+    }
+
+    template <class T> void BasicCalc <T>::addLayer(const shared_ptr <const CalcSource <T> > &source) {
+        freeze();
+
+        shared_ptr <CalcLayer <T> > layer(new CalcLayer <T> ());
+        layer->source = source;
+        layer->parent = layers;
+        layer->depth = layers != nullptr ? layers->depth + 1 : 1;
+
+        layers = layer;
+    }
+
+    template <class T> const T *BasicCalc <T>::findConst(const Input &name) const {
+        const auto found = consts->find(name);
+        if (found != consts->end()) {
+            return &found->second;
+        }
+
+        for (const CalcLayer <T> *layer = layers.get(); layer != nullptr; layer = layer->parent.get()) {
+            const auto found = layer->values.find(name);
+            if (found != layer->values.end()) {
+                return &found->second;
+            }
+
+            if (layer->source != nullptr) {
+                const T *value = layer->source->find(name);
+                if (value != nullptr) {
+                    return value;
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
+    template <class T> map <Input, T> BasicCalc <T>::allConsts() const {
+        vector <const CalcLayer <T> *> chain;
+        for (const CalcLayer <T> *layer = layers.get(); layer != nullptr; layer = layer->parent.get()) {
+            chain.push_back(layer);
+        }
+
+        // Oldest first, newer values replace older ones
+        map <Input, T> result;
+        for (auto layer = chain.rbegin(); layer != chain.rend(); ++layer) {
+            if ((*layer)->source != nullptr) {
+                (*layer)->source->list(result);
+            }
+            for (const auto &item: (*layer)->values) {
+                result[item.first] = item.second;
+            }
+        }
+        for (const auto &item: *consts) {
+            result[item.first] = item.second;
+        }
+
+        return result;
+    }
+
+    template <class T> void BasicCalc <T>::forkTo(BasicCalc <T> &child) {
+        freeze();
+
+        child.own.clear();
+        child.consts = &child.own;
+        child.layers = layers;
+        child.diffIndex = diffIndex;
+        child.budget = budget;
+        child.cancel = cancel;
+        child.threads = threads;
+        child.init();
+    }
+
+    template <class T> void BasicCalc <T>::setDiff(const vector <Input> &names) {
+        diffIndex.clear();
+
+        for (size_t i = 0; i < names.size(); ++i) {
+            check(diffIndex.find(names[i]) == diffIndex.end(), "Duplicated name");
+            diffIndex[names[i]] = i;
+        }
+    }
+
+    template <class T> T BasicCalc <T>::finishByData() {
+        bool isInt;
+        CalcInt intResult;
+
+        return finishByData(isInt, intResult);
+    }
+
+    template <class T> T BasicCalc <T>::finishByData(bool &isInt, CalcInt &intResult) {
+        T result;
+
+        const ParseStatus finalStatus = tryFinishByData(result, isInt, intResult);
+        if (finalStatus.kind != ekNone) {
+            error(errorInfo(finalStatus.kind));
+        }
+
+        return result;
+    }
+
+    template <class T> ParseStatus BasicCalc <T>::tryFinishByData(T &result, bool &isInt, CalcInt &intResult) {
+        vector <PToken> tokens;
+        ParseStatus finalStatus = tryFinish(tokens);
+
+        if (finalStatus.kind != ekNone) {
+            return finalStatus;
+        }
+
+        // Get result
+        PNumToken <T> tResult = nullptr;
+        if (tokens.size() == 1) {
+            tResult = dynamic_pointer_cast <NumToken <T>> (tokens.back());
+        }
+
+        if (tResult == nullptr) {
+            finalStatus.kind = ekBadResult;
+            return finalStatus;
+        }
+
+        (*consts)["ans"] = tResult->value;
+
+        result = tResult->value;
+        isInt = tResult->isInt;
+        intResult = tResult->intValue;
+
+        return finalStatus;
+    }
+
+    template <class T> Input BasicCalc <T>::errorInfo(const int kind) const {
+        switch (kind) {
+        case ekNoOperand:
+            return "No operand";
+        case ekUnknownOperand:
+            return "Unknown operand";
+        case ekAssignCompiling:
+            return "Can not assign when compiling";
+        case ekAssignFunction:
+            return "Can not assign to a function";
+        case ekNoLeftBracket:
+            return "No left bracket";
+        case ekBadLeftBracket:
+            return "Bad left bracket";
+        case ekNoRightBracket:
+            return "No right bracket";
+        case ekBadNumber:
+            return "Wrong format of number";
+        case ekBadArgumentNum:
+            return "Wrong number of arguments";
+        case ekBadVariable:
+            return "Bad variable";
+        case ekBadArgument:
+            return "Bad argument";
+        case ekUnknownName:
+            return "Unknown function or constant";
+        case ekBadResult:
+            return "Bad result";
+        case ekNoCond:
+            return "No ? before :";
+        case ekNoElse:
+            return "No : after ?";
+        case ekNoDiff:
+            return "Can not differentiate";
+        default:
+            return Parser::errorInfo(kind);
         }
     }
 
-    CalcData Calc::finishByData() {
+    template <class T> T BasicCalc <T>::finishByGrad(vector <T> &grad) {
         vector <PToken> result;
         finish(result);
 
         check(result.size() == 1, "Bad result");
 
         // Get result
-        PNumToken tResult = dynamic_pointer_cast <NumToken> (
+        PNumToken <T> tResult = dynamic_pointer_cast <NumToken <T>> (
             result.back()
         );
 
         check(tResult != nullptr, "Bad result");
 
-        GetConst["ans"] = tResult->value;
+        (*consts)["ans"] = tResult->value;
+
+        // Constant result has no derivatives stored
+        grad = tResult->deriv;
+        grad.resize(diffIndex.size(), 0);
 
         return tResult->value;
     }
+
+    template class BasicCalc <float>;
+    template class BasicCalc <double>;
+    template class BasicCalc <long double>;
+#if defined(CALC_FLOAT128)
+    template class BasicCalc <CalcQuad>;
+#endif
 }
@@ -2,21 +2,178 @@
 #define __INC_CALC_HPP__
 
 #include "opcalcrule.hpp"
+#include "opcalcprog.hpp"
 
 namespace OPParser {
+    // Kinds of errors of the calculator
+    enum CalcErrorKind {
+        ekNoOperand = ekUser, ekUnknownOperand, ekAssignCompiling, ekAssignFunction,
+        ekNoLeftBracket, ekBadLeftBracket, ekNoRightBracket, ekBadNumber,
+        ekBadArgumentNum, ekBadVariable, ekBadArgument, ekUnknownName, ekBadResult,
+        ekNoCond, ekNoElse, ekNoDiff
+    };
+
+    // Kinds of tokens in token buffers (see Parser::tryLex), and their payloads
+    enum CalcTokenKind {
+        tkInt,    // The CalcInt
+        tkReal,   // Index of a text, the bytes of the value (not portable)
+        tkName,   // Index of a text, the name
+        tkCall,   // Index of texts, the name and then the arguments as written
+        tkFunc,   // FuncType
+        tkAssign, // Index of a text, the name
+        tkBi,     // BiOperType
+        tkMono,   // MonoOperType
+        tkCond, tkElse, tkLeft, tkRight
+    };
+
+    template <class T> class NumToken;
+    template <class T> class NameToken;
+    template <class T> class CallToken;
+    template <class T> class FuncToken;
+    template <class T> class AssignToken;
+    template <class T> class BiToken;
+    template <class T> class MonoToken;
+    template <class T> class CondToken;
+    template <class T> class ElseToken;
+    template <class T> class NameLexer;
+
+    // Constants and variables kept out of maps, like in a snapshot, never changed
+    template <class T> class CalcSource {
+    public:
+        virtual ~CalcSource() {}
+
+        // Find a value, nullptr if not found
+        virtual const T *find(const Input &name) const = 0;
+
+        // Read all names and values to target
+        virtual void list(map <Input, T> &target) const = 0;
+    };
+
+    // Constants and variables frozen by fork(), shared by forks and never changed
+    template <class T> struct CalcLayer {
+        map <Input, T> values;
+
+        // Read after values, nullptr if none
+        shared_ptr <const CalcSource <T> > source;
+
+        // Older layers, nullptr if none
+        shared_ptr <const CalcLayer <T> > parent;
+
+        // Number of layers to the oldest, including this
+        size_t depth;
+    };
+
     // Calculator, to calculate arithmetic expressions
     // A simple example of implementing of the parser
-    class Calc: public Parser {
+    // T is the value type: float, double, long double or __float128 (CalcQuad)
+    template <class T> class BasicCalc: public Parser {
     protected:
+        // Constants and variables, getConsts <T> () by default
+        map <Input, T> *consts = &getConsts <T> ();
+
+        // Own constants and variables, used after fork()
+        map <Input, T> own = {};
+
+        // Frozen constants and variables, read after consts
+        shared_ptr <const CalcLayer <T> > layers = nullptr;
+
+        // Move consts to a new layer, and write to an empty own map after
+        void freeze();
+
+        // Freeze, then add a layer reading source, over all older values
+        void addLayer(const shared_ptr <const CalcSource <T> > &source);
+
+        // Names to differentiate by, and their index in gradients
+        map <Input, size_t> diffIndex = {};
+
+        // Parameters of the program being compiled, and their index
+        map <Input, size_t> paramIndex = {};
+
+        // The program being compiled, nullptr if not compiling
+        // Tokens record operations to it instead of calculating
+        BasicCalcProgram <T> *program = nullptr;
+
+        // Depth of branches not taken (of ?:, && and ||) being parsed
+        // Tokens in them are checked but not calculated
+        size_t skipping = 0;
+
+        // Clean up and start parsing
+        void reset();
+
+        // Compile input as a function of params, append to the program
+        ParseStatus compileTo(const Input &input, const map <Input, size_t> &params, BasicCalcProgram <T> &target) const;
+
         // Push math tokens' lexers to the parser
-        void addFirstLexers();
+        void addFirstLexers(LexerMap &target);
 
         // Push blank and implicit multiplication
-        void addLastLexers();
+        void addLastLexers(LexerMap &target);
+
+        // Make a token from a token buffer
+        PToken loadToken(const TokenBuffer &tokens, const size_t index) const;
     public:
+        friend class NumToken <T>;
+        friend class NameToken <T>;
+        friend class CallToken <T>;
+        friend class FuncToken <T>;
+        friend class AssignToken <T>;
+        friend class BiToken <T>;
+        friend class MonoToken <T>;
+        friend class CondToken <T>;
+        friend class ElseToken <T>;
+        friend class NameLexer <T>;
+        friend class CalcSheet;
+
+        // Threads calls (like integrate) may use, this thread included
+        // CalcRepl also runs statements in parallel if at least 2, splitting them among the statements
+        unsigned threads = calcThreads();
+
+        // Use another map of constants and variables instead of the default
+        void setConsts(map <Input, T> &target) {
+            consts = &target;
+        }
+
+        // Find a constant or variable, in consts and then in layers
+        // Return nullptr if not found
+        const T *findConst(const Input &name) const;
+
+        // All constants and variables, with layers merged
+        map <Input, T> allConsts() const;
+
+        // Make child an independent copy, between expressions
+        // Constants and variables are frozen into a layer shared by both, so it is O(1)
+        // Later assignments of each go to its own map, not seen by the other
+        void forkTo(BasicCalc <T> &child);
+
+        // Compile an expression to a program
+        // The program's parameters are params, in order
+        PBasicCalcProgram <T> compile(const Input &input, const vector <Input> &params) const;
+
+        // Message of an error kind
+        Input errorInfo(const int kind) const;
+
+        // Set names to differentiate by (forward-mode)
+        // Empty to disable differentiation
+        void setDiff(const vector <Input> &names);
+
+        // Finish parsing and return result
+        T finishByData();
+
         // Finish parsing and return result
-        CalcData finishByData();
+        // If the result is an exact integer, set isInt and return it by intResult
+        T finishByData(bool &isInt, CalcInt &intResult);
+
+        // Finish parsing and set result, see finishByData()
+        // Return the status instead of throwing errors
+        ParseStatus tryFinishByData(T &result, bool &isInt, CalcInt &intResult);
+
+        // Finish parsing and return result
+        // Return derivatives by names set by setDiff() in grad
+        T finishByGrad(vector <T> &grad);
     };
+
+    // The calculator of double, used by the REPL
+    typedef BasicCalc <CalcData> Calc;
 }
 
 #endif
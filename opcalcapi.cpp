@@ -0,0 +1,134 @@
+#include "opcalcapi.h"
+#include "opcalcscan.hpp"
+#include "opcalc.hpp"
+
+using namespace OPParser;
+
+struct calc_handle {
+    Calc calc;
+
+    // Own constants and variables, not GetConst
+    map <Input, CalcData> consts = GetConst;
+
+    // Set by calc_cancel(), cleared when calc_eval finishes
+    atomic <bool> cancelled = {false};
+
+    // Last error, and its message if asked
+    ParseStatus status = {ekNone, 0};
+    string error = "";
+};
+
+calc_handle *calc_new(void) {
+    try {
+        calc_handle *handle = new calc_handle();
+
+        handle->calc.setConsts(handle->consts);
+        handle->calc.cancel = &handle->cancelled;
+        handle->calc.init();
+
+        return handle;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+int calc_eval(calc_handle *handle, const char *input, size_t size, double *result) {
+    if (!handle || (!input && size) || !result) {
+        return -1;
+    }
+
+    try {
+        // Without exceptions, finishing also cleans up if failed
+        bool isInt;
+        CalcInt intResult;
+
+        handle->error.clear();
+        handle->calc.tryParse(Input(input, size));
+        handle->status = handle->calc.tryFinishByData(*result, isInt, intResult);
+
+        // A cancel before starting stops this one, not later ones
+        handle->cancelled = false;
+
+        return handle->status.kind == ekNone ? 0 : -1;
+    } catch (const exception &e) {
+        // Out of memory and so on
+        handle->status = {ekNone, 0};
+        handle->error = e.what();
+
+        handle->calc.recover();
+        handle->cancelled = false;
+
+        return -1;
+    }
+}
+
+int calc_set_var(calc_handle *handle, const char *name, double value) {
+    if (!handle || !name) {
+        return -1;
+    }
+
+    try {
+        handle->status = {ekNone, 0};
+        handle->error = "";
+
+        // Same names as "->"
+        const Input target = name;
+        check(
+            !target.empty() && (charClass(target[0]) & ccAlpha)
+            && scanRun(target.begin(), target.end(), ccAlpha | ccDigit) == target.end(),
+            "Bad name"
+        );
+        check(GetFunc.find(target) == GetFunc.end() && GetCall.find(target) == GetCall.end(), "Can not assign to a function");
+
+        handle->consts[target] = value;
+
+        return 0;
+    } catch (const exception &e) {
+        handle->error = e.what();
+
+        return -1;
+    }
+}
+
+const char *calc_error(calc_handle *handle) {
+    if (!handle) {
+        return "No handle";
+    }
+
+    if (handle->status.kind != ekNone) {
+        handle->error = handle->calc.errorInfo(handle->status.kind);
+    }
+    return handle->error.c_str();
+}
+
+int calc_error_kind(const calc_handle *handle) {
+    return handle ? handle->status.kind : ekNone;
+}
+
+size_t calc_error_offset(const calc_handle *handle) {
+    return handle ? handle->status.offset : 0;
+}
+
+int calc_set_limits(calc_handle *handle, size_t max_input, size_t max_tokens, size_t max_depth, double max_seconds) {
+    if (!handle || !(max_seconds >= 0)) {
+        return -1;
+    }
+
+    ParseBudget &budget = handle->calc.budget;
+    budget.maxInput = max_input;
+    budget.maxTokens = max_tokens;
+    budget.maxDepth = max_depth;
+    budget.maxSeconds = max_seconds;
+
+    return 0;
+}
+
+void calc_cancel(calc_handle *handle) {
+    if (handle) {
+        handle->cancelled = true;
+    }
+}
+
+void calc_free(calc_handle *handle) {
+    delete handle;
+}
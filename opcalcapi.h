@@ -0,0 +1,54 @@
+#ifndef __INC_CALCAPI_H__
+#define __INC_CALCAPI_H__
+
+#include <stddef.h>
+
+/* C API of the calculator (libopparser) */
+/* Handles are independent, each can be used by one thread at a time */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A calculator with its own variables */
+typedef struct calc_handle calc_handle;
+
+/* Create a calculator, NULL if failed */
+calc_handle *calc_new(void);
+
+/* Calculate an expression of size characters */
+/* Return 0 and set result if succeeded, or -1 (see calc_error) */
+int calc_eval(calc_handle *handle, const char *input, size_t size, double *result);
+
+/* Set a variable, like "value -> name" */
+/* Return 0 if succeeded, or -1 (see calc_error) */
+int calc_set_var(calc_handle *handle, const char *name, double value);
+
+/* Message of the last error, valid until the next call with the handle */
+const char *calc_error(calc_handle *handle);
+
+/* Kind of the last error of calc_eval (see ErrorKind and CalcErrorKind), 0 if none */
+int calc_error_kind(const calc_handle *handle);
+
+/* Offset in the input of the last error of calc_eval */
+size_t calc_error_offset(const calc_handle *handle);
+
+/* Limit each calc_eval: characters, tokens, nesting depth and seconds, 0 for no limit */
+/* An expression over a limit fails fast (see ekInputTooLong ... ekTimeout) */
+/* Depth is the size of the operator stack, the operand being read counts too: "((1))" needs 3 */
+/* Return 0 if succeeded, or -1 */
+int calc_set_limits(calc_handle *handle, size_t max_input, size_t max_tokens, size_t max_depth, double max_seconds);
+
+/* Stop the running calc_eval of the handle, it fails with ekCancelled */
+/* If none is running, the next calc_eval is stopped */
+/* Can be called from another thread */
+void calc_cancel(calc_handle *handle);
+
+/* Free a calculator, NULL is ignored */
+void calc_free(calc_handle *handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "opcalcapi.h"
+
+/* Check the C API from C: results, errors, variables, limits and cancelling */
+/* Usage: ./apicheck */
+
+/* Error kinds (see ErrorKind and CalcErrorKind) */
+enum {
+    EK_NONE = 0, EK_UNKNOWN_TOKEN = 1, EK_TOO_DEEP = 7, EK_TIMEOUT = 8, EK_CANCELLED = 9,
+    EK_NO_OPERAND = 64, EK_UNKNOWN_NAME = 75
+};
+
+/* A long calculation, stopped by a limit or calc_cancel */
+static const char *slow = "sum(i, 1, 1000000000000, i)";
+
+static int checked = 0;
+static int failed = 0;
+
+static void expect(const int ok, const char *what) {
+    ++checked;
+    if (!ok) {
+        ++failed;
+        printf("Failed: %s\n", what);
+    }
+}
+
+/* Calculate a NUL-terminated input */
+static int eval(calc_handle *handle, const char *input, double *result) {
+    return calc_eval(handle, input, strlen(input), result);
+}
+
+static void *cancelLater(void *handle) {
+    const struct timespec wait = {0, 50000000};
+
+    nanosleep(&wait, NULL);
+    calc_cancel((calc_handle *) handle);
+    return NULL;
+}
+
+int main(void) {
+    calc_handle *handle = calc_new();
+    double result = 0;
+    pthread_t canceller;
+
+    expect(handle != NULL, "calc_new");
+    if (handle == NULL) {
+        return 1;
+    }
+
+    /* Valid input */
+    expect(eval(handle, "1 + 2 * 3", &result) == 0 && result == 7, "1 + 2 * 3 is 7");
+    expect(calc_error_kind(handle) == EK_NONE, "no error kind after success");
+
+    /* Invalid input: kind and offset of the error */
+    expect(eval(handle, "1 + foo", &result) == -1, "1 + foo fails");
+    expect(calc_error_kind(handle) == EK_UNKNOWN_NAME, "1 + foo is an unknown name");
+    expect(calc_error_offset(handle) == 4, "1 + foo fails at 4");
+    expect(strlen(calc_error(handle)) > 0, "1 + foo has a message");
+
+    expect(eval(handle, "1 +", &result) == -1 && calc_error_kind(handle) == EK_NO_OPERAND, "1 + has no operand");
+    expect(calc_error_offset(handle) == 3, "1 + fails at 3");
+
+    expect(eval(handle, "3 ^^ 2", &result) == -1 && calc_error_kind(handle) == EK_UNKNOWN_TOKEN, "3 ^^ 2 is an unknown token");
+    expect(calc_error_offset(handle) == 3, "3 ^^ 2 fails at 3");
+
+    /* The handle works after errors */
+    expect(eval(handle, "2 ^ 10", &result) == 0 && result == 1024, "2 ^ 10 after errors");
+
+    /* Variables */
+    expect(calc_set_var(handle, "x", 2.5) == 0, "set x");
+    expect(eval(handle, "x * 4", &result) == 0 && result == 10, "x * 4 is 10");
+    expect(calc_set_var(handle, "1x", 1) == -1, "1x is a bad name");
+
+    /* Limits */
+    expect(calc_set_limits(handle, 0, 0, 3, 0) == 0, "set depth limit");
+    expect(eval(handle, "((((1))))", &result) == -1 && calc_error_kind(handle) == EK_TOO_DEEP, "((((1)))) is too deep");
+    expect(eval(handle, "1 + 1", &result) == 0 && result == 2, "1 + 1 is in the depth limit");
+
+    expect(calc_set_limits(handle, 0, 0, 0, 0.05) == 0, "set time limit");
+    expect(eval(handle, slow, &result) == -1 && calc_error_kind(handle) == EK_TIMEOUT, "a long sum times out");
+
+    /* Cancel from another thread */
+    expect(calc_set_limits(handle, 0, 0, 0, 0) == 0, "clear limits");
+    expect(pthread_create(&canceller, NULL, cancelLater, handle) == 0, "start the cancelling thread");
+    expect(eval(handle, slow, &result) == -1 && calc_error_kind(handle) == EK_CANCELLED, "a long sum is cancelled");
+    pthread_join(canceller, NULL);
+
+    /* Cancelling stops one calculation only */
+    expect(eval(handle, "x + 1", &result) == 0 && result == 3.5, "x + 1 after cancelling");
+
+    calc_free(handle);
+    calc_free(NULL);
+
+    printf("%d / %d passed\n", checked - failed, checked);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "opcalc.hpp"
+
+// Cost of recovering from errors, against the number of lexers
+// Usage: ./errbench
+
+namespace OPParser {
+    // Never accepts, to make chains longer
+    class PadLexer: public Lexer {
+    public:
+        bool tryGetToken(InputIter &now, const InputIter &end, Parser &parser) {
+            return 0;
+        }
+    };
+
+    // Calculator with n more lexers of each state
+    template <int n> class PaddedCalc: public Calc {
+    protected:
+        void addLastLexers(LexerMap &target) {
+            Calc::addLastLexers(target);
+
+            for (int i = 0; i < n; ++i) {
+                PLexer lexer(new PadLexer());
+                target[stateNum].push_back(lexer);
+                target[stateOper].push_back(lexer);
+                target[stateAssign].push_back(lexer);
+            }
+        }
+    public:
+        // Build the lexers again, as init() did for each error before
+        size_t rebuild() {
+            LexerMap target;
+            addFirstLexers(target);
+            addLastLexers(target);
+
+            return target[stateNum].size();
+        }
+    };
+
+    // Bad lines of a noisy client
+    const vector <Input> badExprs = {
+        "1 +", "(2 * 3", "4 5)", "..2", "sin", "1 ? 2", "aaa + 1", "2 -> sin"
+    };
+
+    template <int n> void errBench() {
+        const int rounds = 20000;
+
+        PaddedCalc <n> calc;
+        calc.init();
+
+        size_t lexerNum = 0;
+        CalcData recoverTime = 0;
+        CalcData rebuildTime = 0;
+
+        {
+            const auto begin = chrono::steady_clock::now();
+            for (int i = 0; i < rounds; ++i) {
+                for (const Input &expr: badExprs) {
+                    try {
+                        calc.parse(expr);
+                        calc.finishByData();
+                    } catch (const opparser_error &e) {
+                        calc.recover();
+                    }
+                }
+            }
+            const auto end = chrono::steady_clock::now();
+
+            recoverTime = chrono::duration <CalcData, nano> (end - begin).count() / rounds / badExprs.size();
+        }
+
+        {
+            const auto begin = chrono::steady_clock::now();
+            for (int i = 0; i < rounds; ++i) {
+                lexerNum = calc.rebuild();
+            }
+            const auto end = chrono::steady_clock::now();
+
+            rebuildTime = chrono::duration <CalcData, nano> (end - begin).count() / rounds;
+        }
+
+        printf("%8zu %18.1f %18.1f\n", lexerNum, recoverTime, recoverTime + rebuildTime);
+    }
+}
+
+int main() {
+    using namespace std;
+    using namespace OPParser;
+
+    printf("%8s %18s %18s\n", "lexers", "recover ns/line", "rebuild ns/line");
+
+    errBench <0> ();
+    errBench <16> ();
+    errBench <64> ();
+    errBench <256> ();
+}
@@ -0,0 +1,650 @@
+#include <cstring>
+#include <cfloat>
+#include "opcalcfast.hpp"
+
+namespace OPParser {
+    // Round to the nearest integer, for |x| < 2^51
+    inline CalcData roundNear(const CalcData x) {
+        const CalcData magic = 6755399441055744.0; // 1.5 * 2^52
+
+        return (x + magic) - magic;
+    }
+
+    // Reinterpret bits
+    inline uint64_t toBits(const CalcData x) {
+        uint64_t result;
+        memcpy(&result, &x, sizeof(result));
+        return result;
+    }
+
+    inline CalcData fromBits(const uint64_t bits) {
+        CalcData result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    // Kernels use no integer conversions, which SSE2 does not have
+
+    // 2^k, for integral k in [-1022, 1023]
+    inline CalcData pow2(const CalcData k) {
+        // Low bits of 2^52 + n are n
+        return fromBits(toBits(k + (4503599627370496.0 + 1023)) << 52);
+    }
+
+    // sin(r) and cos(r), for |r| <= pi/4 (fdlibm kernels)
+    inline CalcData sinKernel(const CalcData r) {
+        const CalcData z = r * r;
+
+        return r + r * z * (
+            -1.66666666666666324348e-01 + z * (
+            8.33333333332248946124e-03 + z * (
+            -1.98412698298579493134e-04 + z * (
+            2.75573137070700676789e-06 + z * (
+            -2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+    }
+
+    inline CalcData cosKernel(const CalcData r) {
+        const CalcData z = r * r;
+
+        return 1 - (0.5 * z - z * z * (
+            4.16666666666666019037e-02 + z * (
+            -1.38888888888741095749e-03 + z * (
+            2.48015872894767294178e-05 + z * (
+            -2.75573143513906633035e-07 + z * (
+            2.08757232129817482790e-09 + z * -1.13596475577881948265e-11))))));
+    }
+
+    // Reduce x by pi/2, for |x| <= 2^20
+    // Return r in [-pi/4, pi/4] and set the quadrant (0 to 3)
+    inline CalcData reducePi2(const CalcData x, CalcData &quadrant) {
+        // pi/2 in 3 parts, the first 2 have 33 bits
+        const CalcData pi2Part1 = 1.57079632673412561417e+00;
+        const CalcData pi2Part2 = 6.07710050630396597660e-11;
+        const CalcData pi2Part3 = 2.02226624879595063154e-21;
+
+        const CalcData j = roundNear(x * M_2_PI);
+        quadrant = j - 4 * roundNear((j - 1.5) * 0.25);
+
+        return ((x - j * pi2Part1) - j * pi2Part2) - j * pi2Part3;
+    }
+
+    inline CalcData fastSin(const CalcData x, const CalcData shift) {
+        CalcData quadrant;
+        const CalcData r = reducePi2(x, quadrant);
+        quadrant += shift;
+
+        const CalcData s = sinKernel(r);
+        const CalcData c = cosKernel(r);
+        const CalcData result = ((quadrant == 1) | (quadrant == 3)) ? c : s;
+
+        return ((quadrant == 2) | (quadrant == 3)) ? -result : result;
+    }
+
+    inline CalcData fastTan(const CalcData x) {
+        CalcData quadrant;
+        const CalcData r = reducePi2(x, quadrant);
+
+        const CalcData s = sinKernel(r);
+        const CalcData c = cosKernel(r);
+
+        return ((quadrant == 1) | (quadrant == 3)) ? -c / s : s / c;
+    }
+
+    // e^x, for |x| <= 708 (fdlibm kernel)
+    inline CalcData fastExp(const CalcData x) {
+        const CalcData ln2Hi = 6.93147180369123816490e-01;
+        const CalcData ln2Lo = 1.90821492927058770002e-10;
+
+        const CalcData k = roundNear(x * M_LOG2E);
+        const CalcData hi = x - k * ln2Hi;
+        const CalcData lo = k * ln2Lo;
+        const CalcData r = hi - lo;
+        const CalcData z = r * r;
+
+        const CalcData c = r - z * (
+            1.66666666666666019037e-01 + z * (
+            -2.77777777770155933842e-03 + z * (
+            6.61375632143793436117e-05 + z * (
+            -1.65339022054652515390e-06 + z * 4.13813679705723846039e-08))));
+
+        return (1 - ((lo - (r * c) / (2 - c)) - hi)) * pow2(k);
+    }
+
+    // sinh(x) and cosh(x) by Taylor series, for |x| <= 1/2
+    inline CalcData sinhKernel(const CalcData x) {
+        const CalcData z = x * x;
+
+        return x + x * z * (
+            1. / 6 + z * (
+            1. / 120 + z * (
+            1. / 5040 + z * (
+            1. / 362880 + z * (
+            1. / 39916800 + z * (
+            1. / 6227020800 + z * (1. / 1307674368000)))))));
+    }
+
+    inline CalcData coshKernel(const CalcData x) {
+        const CalcData z = x * x;
+
+        return 1 + z * (
+            1. / 2 + z * (
+            1. / 24 + z * (
+            1. / 720 + z * (
+            1. / 40320 + z * (
+            1. / 3628800 + z * (
+            1. / 479001600 + z * (1. / 87178291200)))))));
+    }
+
+    inline CalcData fastSinH(const CalcData x) {
+        const CalcData e = fastExp(abs(x));
+        const CalcData big = copysign(0.5 * e - 0.5 / e, x);
+
+        return abs(x) < 0.5 ? sinhKernel(x) : big;
+    }
+
+    inline CalcData fastCosH(const CalcData x) {
+        const CalcData e = fastExp(abs(x));
+
+        return 0.5 * e + 0.5 / e;
+    }
+
+    inline CalcData fastTanH(const CalcData x) {
+        const CalcData e = fastExp(2 * abs(x));
+        const CalcData big = copysign(1 - 2 / (e + 1), x);
+
+        return abs(x) < 0.5 ? sinhKernel(x) / coshKernel(x) : big;
+    }
+
+    // log(x), for normal positive x (fdlibm kernel)
+    inline CalcData fastLog(const CalcData x) {
+        const CalcData ln2Hi = 6.93147180369123816490e-01;
+        const CalcData ln2Lo = 1.90821492927058770002e-10;
+
+        // x = m * 2^k, m in [sqrt(2) / 2, sqrt(2))
+        const uint64_t sqrtHalf = 0x3fe6a09e667f3bcdull;
+        const uint64_t bits = toBits(x) + (0x3ff0000000000000ull - sqrtHalf);
+
+        // Low bits of 2^52 + n are n
+        const CalcData k = fromBits((bits >> 52) | 0x4330000000000000ull) - (4503599627370496.0 + 1023);
+        const CalcData m = fromBits((bits & 0x000fffffffffffffull) + sqrtHalf);
+
+        const CalcData f = m - 1;
+        const CalcData s = f / (2 + f);
+        const CalcData z = s * s;
+        const CalcData half = 0.5 * f * f;
+        const CalcData r = z * (
+            6.666666666666735130e-01 + z * (
+            3.999999999940941908e-01 + z * (
+            2.857142874366239149e-01 + z * (
+            2.222219843214978396e-01 + z * (
+            1.818357216161805012e-01 + z * (
+            1.531383769920937332e-01 + z * 1.479819860511658591e-01))))));
+
+        return k * ln2Hi - ((half - (s * (half + r) + k * ln2Lo)) - f);
+    }
+
+    // erf(x), for finite x
+    // Polynomials fitted to erf(x) / x - 1 for |x| <= 1.25, and to erfc(|x|) on [1.25, 3] and [3, 6]
+    // erf(x) rounds to 1 for |x| >= 6
+    inline CalcData fastErf(const CalcData x) {
+        const CalcData z = x * x;
+
+        CalcData small = -3.27569319824220684618e-12;
+        small = small * z + 7.95092696740761535086e-11;
+        small = small * z - 1.18945021736353324136e-09;
+        small = small * z + 1.47356021518815895275e-08;
+        small = small * z - 1.63568369947946508181e-07;
+        small = small * z + 1.64613129617002537356e-06;
+        small = small * z - 1.49255998932537060751e-05;
+        small = small * z + 1.20553307602797992468e-04;
+        small = small * z - 8.54832695692666483245e-04;
+        small = small * z + 5.22397762414948760995e-03;
+        small = small * z - 2.68661706449805810781e-02;
+        small = small * z + 1.12837916709542088189e-01;
+        small = small * z - 3.76126389031837315979e-01;
+        small = small * z + 1.28379167095512586316e-01;
+
+        const CalcData a = min(abs(x), 6.0);
+        CalcData s = (a - 2.125) * (1. / 0.875);
+
+        CalcData near = -6.15805344926002915542e-11;
+        near = near * s - 6.15295762973738670729e-11;
+        near = near * s + 1.37520668801184884637e-09;
+        near = near * s - 1.57625426732710234270e-09;
+        near = near * s - 1.47729648746799614767e-08;
+        near = near * s + 5.54329963724335936183e-08;
+        near = near * s + 3.23352719607155039849e-08;
+        near = near * s - 7.01866190154088389762e-07;
+        near = near * s + 1.49372932608862956965e-06;
+        near = near * s + 3.01977057632282317471e-06;
+        near = near * s - 2.18343301395354040843e-05;
+        near = near * s + 3.22981873788081091871e-05;
+        near = near * s + 8.71245740495071223451e-05;
+        near = near * s - 4.75329878638878426233e-04;
+        near = near * s + 7.34049667745045636598e-04;
+        near = near * s + 8.17441444032207943475e-04;
+        near = near * s - 6.40904467511022903070e-03;
+        near = near * s + 1.54522336448640971313e-02;
+        near = near * s - 2.21324804275337266857e-02;
+        near = near * s + 2.00779366635528908058e-02;
+        near = near * s - 1.07982180375419817286e-02;
+        near = near * s + 2.65402935948234885988e-03;
+
+        s = (a - 4.5) * (1. / 1.5);
+
+        CalcData far = -4.06446459412189767360e-11;
+        far = far * s + 1.01725008568493723217e-09;
+        far = far * s - 2.97603510273271076603e-09;
+        far = far * s - 7.50092425024746337934e-10;
+        far = far * s + 1.76164413446054204878e-08;
+        far = far * s - 4.05374328605171092770e-08;
+        far = far * s + 4.80881486499178001940e-08;
+        far = far * s + 3.02972225149930999445e-09;
+        far = far * s - 2.00686562005088790332e-07;
+        far = far * s + 6.47166584018654776176e-07;
+        far = far * s - 1.37280606421808280506e-06;
+        far = far * s + 2.27283396463779170562e-06;
+        far = far * s - 3.11067834130330113357e-06;
+        far = far * s + 3.60103141688190397078e-06;
+        far = far * s - 3.55511257637058448100e-06;
+        far = far * s + 2.99527440935811130175e-06;
+        far = far * s - 2.14344971036935993960e-06;
+        far = far * s + 1.28974752339090722002e-06;
+        far = far * s - 6.41996293711656175516e-07;
+        far = far * s + 2.57899070840119690530e-07;
+        far = far * s - 8.04899027054598107876e-08;
+        far = far * s + 1.83394670824309663309e-08;
+        far = far * s - 2.71695885443167486986e-09;
+        far = far * s + 1.96616061919636201540e-10;
+
+        const CalcData erfc = a < 3 ? near : far;
+        const CalcData big = copysign(a < 6 ? 1 - erfc : 1, x);
+
+        return abs(x) <= 1.25 ? x + x * small : big;
+    }
+
+    // Gamma(x), for x in [-9, 12] and not a pole
+    // Shifted to f in [1, 2] (by products of at most gammaShifts factors), and a polynomial fitted to 1 / Gamma(f)
+    const int gammaShifts = 10;
+
+    inline CalcData fastGamma(const CalcData x) {
+        // x = f + n, n integral
+        const CalcData n = roundNear(x - 1.5);
+        const CalcData f = x - n;
+
+        // Gamma(x) = Gamma(f) * (x - 1) ... (x - n) if n > 0
+        // Gamma(x) = Gamma(f) / (x (x + 1) ... (x - n - 1)) if n < 0
+        CalcData up = 1;
+        CalcData down = 1;
+        for (int k = 1; k <= gammaShifts; ++k) {
+            up *= k <= n ? x - k : 1;
+            down *= k <= -n ? x + (k - 1) : 1;
+        }
+
+        const CalcData s = 2 * f - 3;
+
+        CalcData y = 5.13632535979429235252e-13;
+        y = y * s - 5.49454457678456699326e-12;
+        y = y * s + 7.08667886413032209683e-12;
+        y = y * s + 5.26503364972424992362e-10;
+        y = y * s - 6.78556120803753146973e-09;
+        y = y * s + 2.47608696671636087470e-08;
+        y = y * s + 2.97573483479641848425e-07;
+        y = y * s - 4.33879002311765265133e-06;
+        y = y * s + 1.65682143937206395861e-05;
+        y = y * s + 1.03326528535523676244e-04;
+        y = y * s - 1.31734904276656480601e-03;
+        y = y * s + 3.18542876548270339696e-03;
+        y = y * s + 2.18877532554918111107e-02;
+        y = y * s - 1.31663608881386173799e-01;
+        y = y * s - 2.05872632226415490375e-02;
+        y = y * s + 1.12837916709551255856e+00;
+
+        return up / (y * down);
+    }
+
+    // Run a kernel over values, in blocks
+    // Values not in range use libm
+    template <class Kernel, class InRange>
+    void runKernel(
+        const FuncType type, const CalcData *target, CalcData *result, const size_t n,
+        const Kernel &kernel, const InRange &inRange
+    ) {
+        const size_t blockSize = 64;
+
+        // Copy, as result may be target
+        CalcData block[blockSize];
+
+        // Out of range values are replaced by 1 in kernels
+        CalcData safe[blockSize];
+
+        // Loops are separate, and have no branches or calls, to be vectorized
+        for (size_t begin = 0; begin < n; begin += blockSize) {
+            const size_t size = min(blockSize, n - begin);
+            CalcData *output = result + begin;
+
+            memcpy(block, target + begin, size * sizeof(CalcData));
+
+            for (size_t i = 0; i < size; ++i) {
+                safe[i] = inRange(block[i]) ? block[i] : 1;
+            }
+
+            // Not 0 if any value is replaced
+            uint64_t bad = 0;
+            for (size_t i = 0; i < size; ++i) {
+                bad |= toBits(safe[i]) ^ toBits(block[i]);
+            }
+
+            for (size_t i = 0; i < size; ++i) {
+                output[i] = kernel(safe[i]);
+            }
+
+            if (bad) {
+                for (size_t i = 0; i < size; ++i) {
+                    if (!inRange(block[i])) {
+                        output[i] = calcFunc(type, block[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    // Integer part of a, for a in [0, 2^52)
+    inline CalcData truncAbs(const CalcData a) {
+        // 2^52 + a is rounded to an integer
+        const CalcData r = (a + 4503599627370496.0) - 4503599627370496.0;
+
+        return r > a ? r - 1 : r;
+    }
+
+    // Calculate sign and rounding functions without libm, return false if none
+    // Exact, values of 2^52 or more (and inf, NaN) are integral already
+    bool exactFuncs(const FuncType type, const CalcData *target, CalcData *result, const size_t n) {
+        const CalcData integral = 4503599627370496.0;
+
+        switch (type) {
+        case ftSign:
+            for (size_t i = 0; i < n; ++i) {
+                const CalcData x = target[i];
+                result[i] = (x > 0 ? 1. : 0.) - (x < 0 ? 1. : 0.);
+            }
+            return 1;
+        case ftFloor:
+            for (size_t i = 0; i < n; ++i) {
+                const CalcData x = target[i];
+                const CalcData a = abs(x);
+                const CalcData t = truncAbs(a);
+                const CalcData up = t != a ? t + 1 : t;
+                result[i] = a < integral ? copysign(x < 0 ? -up : t, x) : x;
+            }
+            return 1;
+        case ftCeil:
+            for (size_t i = 0; i < n; ++i) {
+                const CalcData x = target[i];
+                const CalcData a = abs(x);
+                const CalcData t = truncAbs(a);
+                const CalcData up = t != a ? t + 1 : t;
+                result[i] = a < integral ? copysign(x < 0 ? -t : up, x) : x;
+            }
+            return 1;
+        case ftTrunc:
+        case ftInt:
+            for (size_t i = 0; i < n; ++i) {
+                const CalcData x = target[i];
+                const CalcData a = abs(x);
+                result[i] = a < integral ? copysign(truncAbs(a), x) : x;
+            }
+            return 1;
+        case ftRound:
+            // Halves away from 0
+            for (size_t i = 0; i < n; ++i) {
+                const CalcData x = target[i];
+                const CalcData a = abs(x);
+                const CalcData t = truncAbs(a);
+                result[i] = a < integral ? copysign(a - t >= 0.5 ? t + 1 : t, x) : x;
+            }
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    // No exact loops for other types
+    template <class T> bool exactFuncs(const FuncType type, const T *target, T *result, const size_t n) {
+        return 0;
+    }
+
+    // Calculate by kernels, return false if no kernel
+    bool fastFuncs(const FuncType type, const CalcData *target, CalcData *result, const size_t n) {
+        auto trig = [](const CalcData x) {
+            return abs(x) <= 1048576;
+        };
+        auto hyper = [](const CalcData x) {
+            return abs(x) <= 354;
+        };
+        auto positive = [](const CalcData x) {
+            return (x >= DBL_MIN) & (x <= DBL_MAX);
+        };
+        auto finite = [](const CalcData x) {
+            return abs(x) <= DBL_MAX;
+        };
+        auto gamma = [](const CalcData x) {
+            // Not subnormal, and not a pole (0, -1, -2...)
+            return (x >= 1 - gammaShifts) & (x <= 2 + gammaShifts) & (abs(x) >= DBL_MIN) & ((x > 0) | (x != roundNear(x)));
+        };
+
+        switch (type) {
+        case ftSin:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastSin(x, 0);
+            }, trig);
+            return 1;
+        case ftCos:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastSin(x, 1);
+            }, trig);
+            return 1;
+        case ftTan:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastTan(x);
+            }, trig);
+            return 1;
+        case ftSinH:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastSinH(x);
+            }, hyper);
+            return 1;
+        case ftCosH:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastCosH(x);
+            }, hyper);
+            return 1;
+        case ftTanH:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastTanH(x);
+            }, hyper);
+            return 1;
+        case ftLog:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastLog(x);
+            }, positive);
+            return 1;
+        case ftLog10:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastLog(x) * M_LOG10E;
+            }, positive);
+            return 1;
+        case ftLog2:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastLog(x) * M_LOG2E;
+            }, positive);
+            return 1;
+        case ftErf:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastErf(x);
+            }, finite);
+            return 1;
+        case ftGamma:
+            runKernel(type, target, result, n, [](const CalcData x) {
+                return fastGamma(x);
+            }, gamma);
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    // Calculate float by double kernels, return false if no kernel
+    bool fastFuncs(const FuncType type, const float *target, float *result, const size_t n) {
+        switch (type) {
+        case ftSin:
+        case ftCos:
+        case ftTan:
+        case ftSinH:
+        case ftCosH:
+        case ftTanH:
+        case ftLog:
+        case ftLog10:
+        case ftLog2:
+        case ftErf:
+        case ftGamma:
+            break;
+        default:
+            return 0;
+        }
+
+        const size_t blockSize = 256;
+        CalcData block[blockSize];
+
+        for (size_t begin = 0; begin < n; begin += blockSize) {
+            const size_t size = min(blockSize, n - begin);
+
+            for (size_t i = 0; i < size; ++i) {
+                block[i] = target[begin + i];
+            }
+            fastFuncs(type, block, block, size);
+            for (size_t i = 0; i < size; ++i) {
+                result[begin + i] = float(block[i]);
+            }
+        }
+
+        return 1;
+    }
+
+    // No kernels for other types
+    template <class T> bool fastFuncs(const FuncType type, const T *target, T *result, const size_t n) {
+        return 0;
+    }
+
+    template <class T> void calcFuncs(const FuncType type, const T *target, T *result, const size_t n, const FuncMode mode) {
+        const T degree = 180 / calcPi <T> ();
+        const T radian = calcPi <T> () / 180;
+
+        // Exact in both modes
+        switch (type) {
+        case ftSqr:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = target[i] * target[i];
+            }
+            return;
+        case ftSqrt:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = sqrt(target[i]);
+            }
+            return;
+        case ftAbs:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = abs(target[i]);
+            }
+            return;
+        case ftDeg:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = target[i] * degree;
+            }
+            return;
+        case ftRad:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = target[i] * radian;
+            }
+            return;
+        default:
+            break;
+        }
+
+        if (exactFuncs(type, target, result, n)) {
+            return;
+        }
+
+        if (mode == fmFast && fastFuncs(type, target, result, n)) {
+            return;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            result[i] = calcFunc(type, target[i]);
+        }
+    }
+
+    template <class T> void calcBis(const BiOperType type, const T *left, const T *right, T *result, const size_t n) {
+        switch (type) {
+        case otAdd:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = left[i] + right[i];
+            }
+            return;
+        case otSub:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = left[i] - right[i];
+            }
+            return;
+        case otMul:
+        case otIMul:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = left[i] * right[i];
+            }
+            return;
+        case otDiv:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = left[i] / right[i];
+            }
+            return;
+        default:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = calcBi(type, left[i], right[i]);
+            }
+            return;
+        }
+    }
+
+    template <class T> void calcMonos(const MonoOperType type, const T *target, T *result, const size_t n) {
+        switch (type) {
+        case mtNeg:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = -target[i];
+            }
+            return;
+        default:
+            for (size_t i = 0; i < n; ++i) {
+                result[i] = calcMono(type, target[i]);
+            }
+            return;
+        }
+    }
+
+    template void calcFuncs <float> (const FuncType, const float *, float *, const size_t, const FuncMode);
+    template void calcFuncs <double> (const FuncType, const double *, double *, const size_t, const FuncMode);
+    template void calcFuncs <long double> (const FuncType, const long double *, long double *, const size_t, const FuncMode);
+
+    template void calcBis <float> (const BiOperType, const float *, const float *, float *, const size_t);
+    template void calcBis <double> (const BiOperType, const double *, const double *, double *, const size_t);
+    template void calcBis <long double> (const BiOperType, const long double *, const long double *, long double *, const size_t);
+
+    template void calcMonos <float> (const MonoOperType, const float *, float *, const size_t);
+    template void calcMonos <double> (const MonoOperType, const double *, double *, const size_t);
+    template void calcMonos <long double> (const MonoOperType, const long double *, long double *, const size_t);
+
+#if defined(CALC_FLOAT128)
+    template void calcFuncs <CalcQuad> (const FuncType, const CalcQuad *, CalcQuad *, const size_t, const FuncMode);
+    template void calcBis <CalcQuad> (const BiOperType, const CalcQuad *, const CalcQuad *, CalcQuad *, const size_t);
+    template void calcMonos <CalcQuad> (const MonoOperType, const CalcQuad *, CalcQuad *, const size_t);
+#endif
+}
@@ -0,0 +1,33 @@
+#ifndef __INC_CALCFAST_HPP__
+#define __INC_CALCFAST_HPP__
+
+#include "opcalcrule.hpp"
+
+namespace OPParser {
+    // Accuracy of functions over many values
+    // fmExact: libm, one value at a time
+    // fmFast: polynomial kernels, written to be vectorized
+    enum FuncMode {fmExact, fmFast};
+
+    // Calculate a function over n values, result may be target
+    // float uses the double kernels, long double and __float128 have no kernels
+    // Kernels have no branches or calls per value, so they are vectorized (2 doubles a time with SSE2)
+    //
+    // Max errors of fmFast against libm (see fastcheck):
+    //     sin, cos, sinh, cosh    2 ULP
+    //     tan, tanh               3 ULP
+    //     log                     1 ULP
+    //     log10, log2             2 ULP
+    //     erf                     2 ULP
+    //     gamma                   8 ULP, for x in [-9, 12]
+    //     sqr, sqrt, abs, sign, deg, rad, ceil, floor, trunc, round, int    exact, in both modes
+    // Out of scope, libm in both modes: asin, acos, atan, asinh, acosh, atanh, erfc, lgamma, and powers (^, e^x)
+    // Values out of the kernel ranges (huge, NaN, inf, subnormal...) use libm
+    template <class T> void calcFuncs(const FuncType type, const T *target, T *result, const size_t n, const FuncMode mode);
+
+    // Calculate operators over n values, result may be left, right or target
+    template <class T> void calcBis(const BiOperType type, const T *left, const T *right, T *result, const size_t n);
+    template <class T> void calcMonos(const MonoOperType type, const T *target, T *result, const size_t n);
+}
+
+#endif
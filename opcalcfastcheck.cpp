@@ -0,0 +1,141 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include "opcalcfast.hpp"
+
+// Check accuracy and speed of fast functions against libm
+// Usage: ./fastcheck, fails if an error is over its bound (see opcalcfast.hpp)
+
+namespace OPParser {
+    // Distance of doubles in ULP
+    uint64_t ulpDistance(const CalcData a, const CalcData b) {
+        if (a == b || (a != a && b != b)) {
+            return 0;
+        }
+        if (a != a || b != b) {
+            return -1;
+        }
+
+        // Map to ordered integers
+        auto order = [](const CalcData x) {
+            int64_t bits;
+            memcpy(&bits, &x, sizeof(bits));
+            return bits < 0 ? INT64_MIN - bits : bits;
+        };
+
+        const int64_t x = order(a);
+        const int64_t y = order(b);
+        return x > y ? uint64_t(x) - uint64_t(y) : uint64_t(y) - uint64_t(x);
+    }
+
+    struct FastCheck {
+        Input name;
+        FuncType type;
+
+        // Dense range to sample
+        CalcData low;
+        CalcData high;
+
+        // Max error in ULP
+        uint64_t bound;
+    };
+
+    // Sample the dense range, and the full range of doubles if not dense only
+    void sample(const FastCheck &check, vector <CalcData> &values, const bool denseOnly) {
+        mt19937_64 random(1);
+        uniform_real_distribution <CalcData> dense(check.low, check.high);
+
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (denseOnly || i % 2) {
+                values[i] = dense(random);
+            } else {
+                const uint64_t bits = random();
+                memcpy(&values[i], &bits, sizeof(bits));
+            }
+        }
+    }
+
+    // Values per second, in millions
+    CalcData speed(const FastCheck &check, const vector <CalcData> &values, vector <CalcData> &results, const FuncMode mode) {
+        const int rounds = 8;
+
+        const auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            calcFuncs(check.type, values.data(), results.data(), values.size(), mode);
+        }
+        const auto end = chrono::steady_clock::now();
+
+        return values.size() * rounds / chrono::duration <CalcData, micro> (end - begin).count();
+    }
+}
+
+int main() {
+    using namespace std;
+    using namespace OPParser;
+
+    const vector <FastCheck> checks = {
+        {"sin", ftSin, -10, 10, 2},
+        {"cos", ftCos, -10, 10, 2},
+        {"tan", ftTan, -10, 10, 3},
+        {"sinh", ftSinH, -5, 5, 2},
+        {"cosh", ftCosH, -5, 5, 2},
+        {"tanh", ftTanH, -5, 5, 3},
+        {"log", ftLog, 0, 10, 1},
+        {"log10", ftLog10, 0, 10, 2},
+        {"log2", ftLog2, 0, 10, 2},
+        {"erf", ftErf, -6, 6, 2},
+        {"gamma", ftGamma, -9, 12, 8},
+        {"sign", ftSign, -10, 10, 0},
+        {"ceil", ftCeil, -10, 10, 0},
+        {"floor", ftFloor, -10, 10, 0},
+        {"trunc", ftTrunc, -10, 10, 0},
+        {"round", ftRound, -10, 10, 0}
+    };
+
+    vector <CalcData> values(1 << 20);
+    vector <CalcData> exact(values.size());
+    vector <CalcData> fast(values.size());
+
+    printf("%-8s %10s %14s %14s\n", "func", "max ulp", "libm M/s", "fast M/s");
+
+    int failed = 0;
+
+    for (const FastCheck &check: checks) {
+        // Speed in the dense range
+        sample(check, values, 1);
+        const CalcData exactSpeed = speed(check, values, exact, fmExact);
+        const CalcData fastSpeed = speed(check, values, fast, fmFast);
+
+        // Against libm one value at a time, as both modes may use kernels
+        sample(check, values, 0);
+        for (size_t i = 0; i < values.size(); ++i) {
+            exact[i] = calcFunc(check.type, values[i]);
+        }
+        calcFuncs(check.type, values.data(), fast.data(), values.size(), fmFast);
+
+        uint64_t maxUlp = 0;
+        CalcData worst = 0;
+        for (size_t i = 0; i < values.size(); ++i) {
+            const uint64_t ulp = ulpDistance(exact[i], fast[i]);
+
+            if (maxUlp < ulp) {
+                maxUlp = ulp;
+                worst = values[i];
+            }
+        }
+
+        printf("%-8s %10llu %14.1f %14.1f", check.name.c_str(), (unsigned long long) maxUlp, exactSpeed, fastSpeed);
+        if (maxUlp) {
+            printf("    (at %.17g)", worst);
+        }
+        if (maxUlp > check.bound) {
+            printf("    FAIL, over %llu", (unsigned long long) check.bound);
+            ++failed;
+        }
+        printf("\n");
+    }
+
+    return failed != 0;
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <cstdio>
+#include <cctype>
+#include <chrono>
+#include "opcalc.hpp"
+
+// Compare integer-heavy expressions on the int64 path and forced to double
+// Integer literals are written with "." (like "12."), so they are parsed as doubles
+// Usage: ./intbench
+
+namespace OPParser {
+    // A term repeated to a long expression, and the number of times
+    struct IntBench {
+        Input term;
+        Input last;
+        size_t count;
+    };
+
+    const vector <IntBench> benchExprs = {
+        {"12345 * 678 + 9 % 7 - 1000 * 3 + ", "0", 2000},
+        {"(17 ^ 3 - 4913) * 5 + ", "1", 2000},
+        {"-(123456789 * 1000 % 97) + ", "2", 2000},
+        {"5! * 6! % 1000 - ", "3", 2000},
+        {"2 ^ 62 + ", "1", 1}
+    };
+
+    Input repeat(const IntBench &bench) {
+        Input result;
+        for (size_t i = 0; i < bench.count; ++i) {
+            result += bench.term;
+        }
+        return result + bench.last;
+    }
+
+    // Add "." to integer literals
+    Input toDouble(const Input &input) {
+        Input result;
+
+        for (size_t i = 0; i < input.size(); ++i) {
+            result += input[i];
+
+            if (isdigit(input[i]) && (i + 1 == input.size() || (!isdigit(input[i + 1]) && input[i + 1] != '.'))) {
+                result += '.';
+            }
+        }
+        return result;
+    }
+
+    // Milliseconds per parse, and the result
+    CalcData time(Calc &calc, const Input &input, CalcData &value) {
+        const int rounds = 20;
+
+        const auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            calc.parse(input);
+            value = calc.finishByData();
+        }
+        const auto end = chrono::steady_clock::now();
+
+        return chrono::duration <CalcData, milli> (end - begin).count() / rounds;
+    }
+}
+
+int main() {
+    using namespace std;
+    using namespace OPParser;
+
+    Calc calc;
+    calc.init();
+
+    printf("%-36s %10s %10s %8s %6s %s\n", "term", "int ms", "double ms", "speedup", "exact", "same");
+
+    for (const IntBench &bench: benchExprs) {
+        const Input input = repeat(bench);
+
+        CalcData intValue;
+        CalcData doubleValue;
+        const CalcData intTime = time(calc, input, intValue);
+        const CalcData doubleTime = time(calc, toDouble(input), doubleValue);
+
+        // Doubles may round, where integers are exact
+        bool isInt;
+        CalcInt exact;
+        calc.parse(input);
+        calc.finishByData(isInt, exact);
+
+        const bool same = isInt ? CalcData(exact) == doubleValue && CalcInt(doubleValue) == exact : intValue == doubleValue;
+
+        printf("%-36s %10.3f %10.3f %8.2f %6s %s\n",
+            (bench.term + bench.last).c_str(), intTime, doubleTime, doubleTime / intTime,
+            isInt ? "yes" : "no", same ? "yes" : "no");
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef __INC_CALCMATH_HPP__
+#define __INC_CALCMATH_HPP__
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+// __float128 needs libquadmath, define CALC_NO_FLOAT128 to disable it
+#if defined(__SIZEOF_FLOAT128__) && !defined(CALC_NO_FLOAT128)
+    #define CALC_FLOAT128
+    #include <quadmath.h>
+#endif
+
+namespace OPParser {
+    using namespace std;
+
+    // Math functions of all value types (float, double, long double and __float128)
+    // Call them unqualified, like sin(x)
+
+#if defined(CALC_FLOAT128)
+    typedef __float128 CalcQuad;
+
+    // Keep std overloads visible beside the __float128 ones
+    using std::sin; using std::cos; using std::tan; using std::asin; using std::acos; using std::atan;
+    using std::sinh; using std::cosh; using std::tanh; using std::asinh; using std::acosh; using std::atanh;
+    using std::exp; using std::log; using std::log10; using std::log2; using std::sqrt; using std::pow;
+    using std::abs; using std::fmod; using std::ceil; using std::floor; using std::trunc; using std::round;
+    using std::erf; using std::erfc; using std::tgamma; using std::lgamma; using std::signbit;
+    using std::isinf; using std::isnan;
+
+    inline CalcQuad sin(const CalcQuad x) {return sinq(x);}
+    inline CalcQuad cos(const CalcQuad x) {return cosq(x);}
+    inline CalcQuad tan(const CalcQuad x) {return tanq(x);}
+    inline CalcQuad asin(const CalcQuad x) {return asinq(x);}
+    inline CalcQuad acos(const CalcQuad x) {return acosq(x);}
+    inline CalcQuad atan(const CalcQuad x) {return atanq(x);}
+    inline CalcQuad sinh(const CalcQuad x) {return sinhq(x);}
+    inline CalcQuad cosh(const CalcQuad x) {return coshq(x);}
+    inline CalcQuad tanh(const CalcQuad x) {return tanhq(x);}
+    inline CalcQuad asinh(const CalcQuad x) {return asinhq(x);}
+    inline CalcQuad acosh(const CalcQuad x) {return acoshq(x);}
+    inline CalcQuad atanh(const CalcQuad x) {return atanhq(x);}
+    inline CalcQuad exp(const CalcQuad x) {return expq(x);}
+    inline CalcQuad log(const CalcQuad x) {return logq(x);}
+    inline CalcQuad log10(const CalcQuad x) {return log10q(x);}
+    inline CalcQuad log2(const CalcQuad x) {return log2q(x);}
+    inline CalcQuad sqrt(const CalcQuad x) {return sqrtq(x);}
+    inline CalcQuad pow(const CalcQuad x, const CalcQuad y) {return powq(x, y);}
+    inline CalcQuad abs(const CalcQuad x) {return fabsq(x);}
+    inline CalcQuad fmod(const CalcQuad x, const CalcQuad y) {return fmodq(x, y);}
+    inline CalcQuad ceil(const CalcQuad x) {return ceilq(x);}
+    inline CalcQuad floor(const CalcQuad x) {return floorq(x);}
+    inline CalcQuad trunc(const CalcQuad x) {return truncq(x);}
+    inline CalcQuad round(const CalcQuad x) {return roundq(x);}
+    inline CalcQuad erf(const CalcQuad x) {return erfq(x);}
+    inline CalcQuad erfc(const CalcQuad x) {return erfcq(x);}
+    inline CalcQuad tgamma(const CalcQuad x) {return tgammaq(x);}
+    inline CalcQuad lgamma(const CalcQuad x) {return lgammaq(x);}
+    inline bool signbit(const CalcQuad x) {return signbitq(x);}
+    inline bool isinf(const CalcQuad x) {return isinfq(x);}
+    inline bool isnan(const CalcQuad x) {return isnanq(x);}
+#endif
+
+    // Bits of mantissa
+    template <class T> int calcDigits() {
+        return numeric_limits <T>::digits;
+    }
+
+#if defined(CALC_FLOAT128)
+    template <> inline int calcDigits <CalcQuad> () {
+        return FLT128_MANT_DIG;
+    }
+#endif
+
+    // Distance from 1 to the next value
+    template <class T> T calcEpsilon() {
+        T result = 1;
+        for (int i = 1; i < calcDigits <T> (); ++i) {
+            result /= 2;
+        }
+        return result;
+    }
+
+    // pi in full precision
+    template <class T> T calcPi() {
+        return acos(T(-1));
+    }
+
+    // Read a number like strtod
+    inline void calcFromString(const char *input, char **end, float &result) {
+        result = strtof(input, end);
+    }
+
+    inline void calcFromString(const char *input, char **end, double &result) {
+        result = strtod(input, end);
+    }
+
+    inline void calcFromString(const char *input, char **end, long double &result) {
+        result = strtold(input, end);
+    }
+
+#if defined(CALC_FLOAT128)
+    inline void calcFromString(const char *input, char **end, CalcQuad &result) {
+        result = strtoflt128(input, end);
+    }
+#endif
+}
+
+#endif
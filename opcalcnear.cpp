@@ -1,7 +1,92 @@
+#include <algorithm>
+#include <cmath>
 #include "opcalcnear.hpp"
 
 namespace OPParser {
-    const map <CalcNearData, Output> NearValue = {
+    const NearEntry NearValue[] = {
         #include "nearnum.inc"
     };
+
+    const size_t NearValueSize = sizeof(NearValue) / sizeof(NearValue[0]);
+
+    NearIndex::NearIndex(const NearEntry *table, const size_t size): keys(size + 1), order(size + 1), entries(table, table + size) {
+        stable_sort(entries.begin(), entries.end(), [](const NearEntry &a, const NearEntry &b) {
+            return abs(a.value) < abs(b.value);
+        });
+
+        build(1, 0);
+    }
+
+    size_t NearIndex::build(const size_t k, size_t i) {
+        if (k < keys.size()) {
+            i = build(2 * k, i);
+            keys[k] = abs(entries[i].value);
+            order[k] = i++;
+            i = build(2 * k + 1, i);
+        }
+
+        return i;
+    }
+
+    size_t NearIndex::lowerBound(const double x) const {
+        const size_t n = keys.size() - 1;
+        const double *data = keys.data();
+
+        // Go left if keys[k] >= x, prefetching 3 levels below
+        size_t k = 1;
+        while (k <= n) {
+            __builtin_prefetch(data + k * 8);
+            k = 2 * k + (data[k] < x);
+        }
+
+        // Undo the right turns after the last left turn
+        k >>= __builtin_ffsll(~k);
+
+        return k == 0 ? n : order[k];
+    }
+
+    size_t NearIndex::find(const double x, const double tolerance, NearMatch *matches, const size_t max) const {
+        const double target = abs(x);
+        const double low = target * (1 - tolerance);
+        const double high = target * (1 + tolerance);
+
+        size_t found = 0;
+
+        // Keep the best max matches, by insertion
+        auto better = [](const NearMatch &a, const NearMatch &b) {
+            if (a.negated != b.negated) {
+                return b.negated;
+            }
+            if (a.entry->rank != b.entry->rank) {
+                return a.entry->rank < b.entry->rank;
+            }
+            return a.error < b.error;
+        };
+
+        if (!(target > 0) || isinf(target) || max == 0) {
+            return 0;
+        }
+
+        for (size_t i = lowerBound(low); i < entries.size() && abs(entries[i].value) <= high; ++i) {
+            const NearEntry *entry = &entries[i];
+            const NearMatch match = {entry, signbit(entry->value) != signbit(x), abs(abs(entry->value) - target) / target};
+
+            size_t j = min(found, max - 1);
+            if (j == found || better(match, matches[j])) {
+                while (j > 0 && better(match, matches[j - 1])) {
+                    matches[j] = matches[j - 1];
+                    --j;
+                }
+                matches[j] = match;
+                found = min(found + 1, max);
+            }
+        }
+
+        return found;
+    }
+
+    const NearIndex &nearIndex() {
+        static const NearIndex index(NearValue, NearValueSize);
+        return index;
+    }
 }
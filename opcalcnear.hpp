@@ -1,8 +1,9 @@
 #ifndef __INC_CALCNEAR_HPP__
 #define __INC_CALCNEAR_HPP__
 
-#include <map>
+#include <cstddef>
 #include <string>
+#include <vector>
 
 // Get near value
 #define fnear(x) ((x) + 65536 - 65536)
@@ -16,8 +17,58 @@ namespace OPParser {
     // Near value type
     typedef float CalcNearData;
 
-    // Known value table, like {0.5, "1 / 2"}
-    extern const map <CalcNearData, Output> NearValue;
+    // A known value, like {0.5, 1, "1 / 2"}
+    // Lower rank is simpler
+    struct NearEntry {
+        double value;
+        int rank;
+        const char *text;
+    };
+
+    // Known value table, sorted by value
+    extern const NearEntry NearValue[];
+    extern const size_t NearValueSize;
+
+    // A known value close to a result
+    struct NearMatch {
+        const NearEntry *entry;
+
+        // The result is close to -value
+        bool negated;
+
+        // Relative error
+        double error;
+    };
+
+    // Known values by absolute value, in Eytzinger (breadth-first) order
+    // Search is branchless, and the top levels share cache lines
+    class NearIndex {
+    protected:
+        // keys[1..n] in Eytzinger order, keys[0] unused
+        vector <double> keys;
+
+        // Sorted position of keys[k]
+        vector <size_t> order;
+
+        // Entries sorted by absolute value
+        vector <NearEntry> entries;
+
+        // Fill keys in order, return the next sorted position
+        size_t build(const size_t k, size_t i);
+
+        // First sorted position with absolute value >= x
+        size_t lowerBound(const double x) const;
+    public:
+        NearIndex(const NearEntry *table, const size_t size);
+
+        // Find known values within relative tolerance of x (of both signs)
+        // Ranked by sign (same first), simplicity, then error
+        // At most max matches, return the number found
+        size_t find(const double x, const double tolerance, NearMatch *matches, const size_t max) const;
+    };
+
+    // Index of NearValue, built on first use
+    const NearIndex &nearIndex();
 }
 
 #endif
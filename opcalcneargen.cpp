@@ -0,0 +1,209 @@
+#include <iostream>
+#include <cstdio>
+#include <thread>
+#include <algorithm>
+#include "opcalc.hpp"
+#include "opcalcnear.hpp"
+
+// Generator of nearnum.inc
+// Usage: ./neargen > nearnum.inc
+
+namespace OPParser {
+    // A closed form to approximate results
+    struct NearForm {
+        Output text;
+
+        // Simplicity ranking, lower is simpler
+        // Compared by kind, then by the integers used
+        int kind;
+        int size;
+
+        CalcData value;
+    };
+
+    bool simpler(const NearForm &a, const NearForm &b) {
+        if (a.kind != b.kind) {
+            return a.kind < b.kind;
+        }
+        if (a.size != b.size) {
+            return a.size < b.size;
+        }
+        return a.text < b.text;
+    }
+
+    // Max integer in forms
+    const int nearMax = 255;
+
+    // Enumerate candidate forms
+    void addForms(vector <NearForm> &forms) {
+        const vector <Output> consts = {"pi", "e"};
+        const vector <Output> logs = {"log", "log10", "log2"};
+        const vector <Output> trigs = {"sin", "cos", "tan", "atan"};
+        const vector <Output> angles = {"pi", "e", "(e * pi)", "(pi * pi)"};
+
+        auto add = [&](const Output &text, const int kind, const int size) {
+            forms.push_back({text, kind, size, 0});
+        };
+
+        // Constants
+        for (const Output &c: consts) {
+            add(c, 0, 0);
+            add("- " + c, 0, 0);
+        }
+
+        // Fractions
+        for (int a = 1; a <= nearMax; ++a) {
+            for (int b = 2; b <= nearMax; ++b) {
+                int x = a;
+                int y = b;
+                while (y) {
+                    const int z = x % y;
+                    x = y;
+                    y = z;
+                }
+
+                if (x == 1) {
+                    add(to_string(a) + " / " + to_string(b), 1, a + b);
+                }
+            }
+        }
+
+        // Arithmetic with constants
+        add("pi * e", 2, 0);
+        add("pi / e", 2, 0);
+        add("e / pi", 2, 0);
+        add("pi + e", 2, 0);
+        add("pi - e", 2, 0);
+        add("e - pi", 2, 0);
+        for (const Output &c: consts) {
+            for (int n = 1; n <= nearMax; ++n) {
+                const Output num = to_string(n);
+
+                if (n > 1) {
+                    add(num + " * " + c, 2, n);
+                    add(c + " / " + num, 2, n);
+                }
+                add(num + " / " + c, 2, n);
+                add(num + " + " + c, 2, n);
+                add(num + " - " + c, 2, n);
+                add(c + " - " + num, 2, n);
+            }
+        }
+
+        // Roots
+        for (int n = 2; n <= nearMax; ++n) {
+            add("sqrt " + to_string(n), 3, n);
+        }
+        for (const Output &c: consts) {
+            add("sqrt " + c, 3, 0);
+        }
+
+        // Powers
+        add("pi ^ e", 4, 0);
+        add("pi ^ pi", 4, 0);
+        for (const Output &c: consts) {
+            add(c + " !", 4, 0);
+            for (int n = 2; n <= nearMax; ++n) {
+                add(c + " ^ " + to_string(n), 4, n);
+                add(to_string(n) + " ^ " + c, 4, n);
+            }
+        }
+
+        // Logarithms
+        for (const Output &f: logs) {
+            for (int n = 2; n <= nearMax; ++n) {
+                add(f + " " + to_string(n), 5, n);
+            }
+            for (const Output &c: consts) {
+                add(f + " " + c, 5, 0);
+            }
+        }
+
+        // Trigonometric functions
+        for (const Output &f: trigs) {
+            for (int n = 1; n <= nearMax; ++n) {
+                add(f + " " + to_string(n), 6, n);
+            }
+            for (const Output &c: angles) {
+                add(f + " " + c, 6, 0);
+            }
+        }
+    }
+
+    // Evaluate forms with the calculator, in parallel
+    void evalForms(vector <NearForm> &forms) {
+        const unsigned threads = calcThreads();
+
+        auto work = [&](const unsigned offset) {
+            Calc calc;
+
+            for (size_t i = offset; i < forms.size(); i += threads) {
+                try {
+                    forms[i].value = calc.compile(forms[i].text, {})->run({});
+                } catch (const opparser_error &e) {
+                    forms[i].value = NAN;
+                }
+            }
+        };
+
+        vector <thread> workers;
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.push_back(thread(work, i));
+        }
+        for (thread &worker: workers) {
+            worker.join();
+        }
+    }
+}
+
+int main() {
+    using namespace std;
+    using namespace OPParser;
+
+    vector <NearForm> forms;
+    addForms(forms);
+    evalForms(forms);
+
+    // Keep the simplest form of each value
+    map <CalcData, NearForm> table;
+    for (const NearForm &form: forms) {
+        if (!(form.value == form.value)) {
+            cerr<<"Bad form: "<<form.text<<endl;
+            continue;
+        }
+
+        // Integers are shown exactly
+        if (form.value == round(form.value)) {
+            continue;
+        }
+
+        const auto found = table.find(form.value);
+        if (found == table.end() || simpler(form, found->second)) {
+            table[form.value] = form;
+        }
+    }
+
+    // Rank by simplicity
+    vector <NearForm> ranked;
+    for (const auto &item: table) {
+        ranked.push_back(item.second);
+    }
+    sort(ranked.begin(), ranked.end(), simpler);
+
+    map <Output, size_t> ranks;
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        ranks[ranked[i].text] = i;
+    }
+
+    // Write table, sorted by value
+    char buffer[64];
+    for (auto iter = table.begin(); iter != table.end(); ++iter) {
+        snprintf(buffer, sizeof(buffer), "%.17g", iter->second.value);
+
+        cout<<"{"<<buffer<<", "<<ranks[iter->second.text]<<", \""<<iter->second.text<<"\"}";
+        if (next(iter) != table.end()) {
+            cout<<",";
+        }
+        cout<<"\n";
+    }
+}
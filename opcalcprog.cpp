@@ -0,0 +1,1121 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <unordered_map>
+#include "opcalcprog.hpp"
+
+namespace OPParser {
+    template <class T> void BasicCalcProgram <T>::push(const BasicProgOper <T> &oper, const size_t popNum) {
+        check(size >= popNum, "No operand");
+
+        opers.push_back(oper);
+
+        size = size - popNum + 1;
+        if (depth < size) {
+            depth = size;
+        }
+    }
+
+    template <class T> bool BasicCalcProgram <T>::lastNums(const size_t n, T *values) const {
+        if (opers.size() < n) {
+            return 0;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            const BasicProgOper <T> &oper = opers[opers.size() - n + i];
+
+            if (oper.kind != poNum) {
+                return 0;
+            }
+            values[i] = oper.value;
+        }
+
+        return 1;
+    }
+
+    template <class T> void BasicCalcProgram <T>::pushNum(const T value) {
+        push({poNum, 0, 0, value}, 0);
+    }
+
+    template <class T> void BasicCalcProgram <T>::pushParam(const size_t index) {
+        check(index < paramNum, "Unknown parameter");
+
+        push({poParam, 0, index, 0}, 0);
+    }
+
+    template <class T> void BasicCalcProgram <T>::pushBi(const BiOperType type) {
+        T values[2];
+
+        if (lastNums(2, values)) {
+            // Fold
+            opers.resize(opers.size() - 2);
+            size -= 2;
+            pushNum(calcBi(type, values[0], values[1]));
+        } else {
+            push({poBi, type, 0, 0}, 2);
+        }
+    }
+
+    template <class T> void BasicCalcProgram <T>::pushMono(const MonoOperType type) {
+        T values[1];
+
+        if (lastNums(1, values)) {
+            // Fold
+            opers.back().value = calcMono(type, values[0]);
+        } else {
+            push({poMono, type, 0, 0}, 1);
+        }
+    }
+
+    template <class T> void BasicCalcProgram <T>::pushFunc(const FuncType type) {
+        T values[1];
+
+        if (lastNums(1, values)) {
+            // Fold
+            opers.back().value = calcFunc(type, values[0]);
+        } else {
+            push({poFunc, type, 0, 0}, 1);
+        }
+    }
+
+    template <class T> void BasicCalcProgram <T>::pushCall(const CallType type, const PBasicCalcProgram <T> body) {
+        check(body->getParamNum() == paramNum + 1, "Bad body");
+
+        const size_t toMap[] = {2, 1, 2, 2};
+
+        push({poCall, type, bodies.size(), 0}, toMap[type]);
+        bodies.push_back(body);
+    }
+
+    template <class T> size_t BasicCalcProgram <T>::pushCond() {
+        // The condition stays on stack for runColumns()
+        push({poCond, 0, 0, 0}, 1);
+
+        return opers.size() - 1;
+    }
+
+    template <class T> size_t BasicCalcProgram <T>::pushElse(const size_t condIndex) {
+        push({poJump, 0, 0, 0}, 1);
+        opers[condIndex].index = opers.size();
+
+        return opers.size() - 1;
+    }
+
+    template <class T> void BasicCalcProgram <T>::pushSelect(const size_t elseIndex) {
+        opers[elseIndex].index = opers.size();
+        push({poSelect, 0, 0, 0}, 3);
+    }
+
+    // Run a body with the parameters of the caller and a new parameter
+    template <class T> class BodyRunner {
+    protected:
+        const BasicCalcProgram <T> &body;
+        vector <T> params;
+        vector <T> stack;
+    public:
+        // If infinite, x = t / (1 - t^2), to map (-1, 1) to (-inf, inf)
+        bool infinite = 0;
+
+        // Passed to calls in the body too
+        const CalcStopper *stop;
+
+        BodyRunner(const BasicCalcProgram <T> &toBody, const T *toParams, const CalcStopper *toStop):
+            body(toBody),
+            params(toParams, toParams + toBody.getParamNum() - 1),
+            stack(toBody.getDepth()),
+            stop(toStop) {
+            params.push_back(0);
+        }
+
+        bool stopped() const {
+            return stop != nullptr && stop->stopped();
+        }
+
+        T operator()(const T x) {
+            if (infinite) {
+                const T scale = 1 / (1 - x * x);
+
+                params.back() = x * scale;
+                return body.run(params.data(), stack.data(), 1, stop) * (1 + x * x) * scale * scale;
+            } else {
+                params.back() = x;
+                return body.run(params.data(), stack.data(), 1, stop);
+            }
+        }
+    };
+
+    // Gauss-Kronrod (7, 15) rule
+    // Return the integration and set the error estimation
+    template <class T> T gaussKronrod(BodyRunner <T> &f, const T a, const T b, T &err) {
+        const T nodes[] = {
+            0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+            0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+            0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+            0.207784955007898467600689403773245
+        };
+        const T kronrod[] = {
+            0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+            0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+            0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+            0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+        };
+        const T gauss[] = {
+            0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+            0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+        };
+
+        const T mid = (a + b) / 2;
+        const T half = (b - a) / 2;
+
+        const T center = f(mid);
+        T resultK = center * kronrod[7];
+        T resultG = center * gauss[3];
+
+        for (int i = 0; i < 7; ++i) {
+            const T sum = f(mid - half * nodes[i]) + f(mid + half * nodes[i]);
+
+            resultK += sum * kronrod[i];
+            if (i % 2) {
+                resultG += sum * gauss[i / 2];
+            }
+        }
+
+        err = abs((resultK - resultG) * half);
+        return resultK * half;
+    }
+
+    // Adaptive integration by bisection
+    // NaN if stopped
+    template <class T> T integratePart(BodyRunner <T> &f, const T a, const T b, const int depth) {
+        if (f.stopped()) {
+            return T(NAN);
+        }
+
+        T err;
+        const T result = gaussKronrod(f, a, b, err);
+
+        // Tolerances of double, or looser if T can not reach them
+        static const T relative = max(T(1e-10), calcEpsilon <T> () * 64);
+        static const T absolute = max(T(1e-14), calcEpsilon <T> () / 64);
+
+        // Stop at good precision, max depth or NaN
+        if (err <= relative * abs(result) || err <= absolute || depth == 0 || !(err == err)) {
+            return result;
+        }
+
+        const T mid = (a + b) / 2;
+        return integratePart(f, a, mid, depth - 1) + integratePart(f, mid, b, depth - 1);
+    }
+
+    // Estimated work (in seconds) for threads to pay for starting them
+    const double parallelSeconds = 1e-3;
+
+    // Run work(index) on threadNum threads, this thread with index 0
+    template <class F> void runThreads(const unsigned threadNum, const F &work) {
+        vector <thread> workers;
+        for (unsigned i = 1; i < threadNum; ++i) {
+            workers.push_back(thread(work, i));
+        }
+
+        work(0);
+
+        for (thread &worker: workers) {
+            worker.join();
+        }
+    }
+
+    // Integrate over [a, b]
+    // The interval is split into fixed panels, so the result does not depend on threads
+    // Threads are used if the first panel shows the others are long enough
+    template <class T> T integrate(const BasicCalcProgram <T> &body, const T *params, T a, T b, const unsigned threads, const CalcStopper *stop) {
+        const int panelNum = 16;
+        const int maxDepth = 40;
+
+        bool infinite = isinf(a) || isinf(b);
+        if (infinite) {
+            // t = x / (1 + sqrt(1 + 4x^2)) * 2
+            a = isinf(a) ? (a > 0 ? 1 : -1) : 2 * a / (1 + sqrt(1 + 4 * a * a));
+            b = isinf(b) ? (b > 0 ? 1 : -1) : 2 * b / (1 + sqrt(1 + 4 * b * b));
+        }
+
+        T results[panelNum];
+
+        // Panels from first, every step
+        auto work = [&](const int first, const int step) {
+            BodyRunner <T> f(body, params, stop);
+            f.infinite = infinite;
+
+            for (int i = first; i < panelNum; i += step) {
+                results[i] = integratePart(
+                    f, a + (b - a) * i / panelNum, a + (b - a) * (i + 1) / panelNum, maxDepth
+                );
+            }
+        };
+
+        // The first panel estimates the work of the others
+        const auto begin = chrono::steady_clock::now();
+        work(0, panelNum);
+        const chrono::duration <double> elapsed = chrono::steady_clock::now() - begin;
+
+        const unsigned threadNum = elapsed.count() * (panelNum - 1) >= parallelSeconds
+            ? max(min(threads, unsigned(panelNum - 1)), 1u) : 1;
+        runThreads(threadNum, [&](const unsigned index) {
+            work(1 + index, threadNum);
+        });
+
+        // Sum in order
+        T result = 0;
+        for (int i = 0; i < panelNum; ++i) {
+            result += results[i];
+        }
+        return result;
+    }
+
+    // Find a root near x0, by secant method
+    // Return NaN if not found
+    template <class T> T solve(const BasicCalcProgram <T> &body, const T *params, const T x0, const CalcStopper *stop) {
+        const int maxStep = 100;
+
+        // Tolerance of double, or looser if T can not reach it
+        static const T tolerance = max(T(1e-15), calcEpsilon <T> () * 4);
+
+        BodyRunner <T> f(body, params, stop);
+
+        T x1 = x0;
+        T x2 = x0 + (abs(x0) > 1 ? 1e-4 * x0 : 1e-4);
+        T f1 = f(x1);
+        T f2 = f(x2);
+
+        for (int i = 0; i < maxStep; ++i) {
+            if (f2 == 0) {
+                return x2;
+            }
+            if (f2 == f1 || !(f2 == f2) || f.stopped()) {
+                break;
+            }
+
+            const T x3 = x2 - f2 * (x2 - x1) / (f2 - f1);
+
+            if (abs(x3 - x2) <= tolerance * max(abs(x3), T(1))) {
+                return x3;
+            }
+
+            x1 = x2;
+            f1 = f2;
+            x2 = x3;
+            f2 = f(x3);
+        }
+
+        return T(NAN);
+    }
+
+    // Combine values pairwise in order, in a fixed tree (like a binary counter)
+    // Only O(log n) values are kept
+    template <class T> class PairwiseReducer {
+    protected:
+        bool product;
+
+        // Values of whole subtrees, and their height
+        vector <pair <T, size_t>> stack = {};
+
+        T combine(const T left, const T right) const {
+            return product ? left * right : left + right;
+        }
+    public:
+        PairwiseReducer(const bool toProduct): product(toProduct) {}
+
+        void push(T value) {
+            size_t height = 0;
+            while (!stack.empty() && stack.back().second == height) {
+                value = combine(stack.back().first, value);
+                stack.pop_back();
+                ++height;
+            }
+            stack.push_back({value, height});
+        }
+
+        // At least one value should be pushed
+        T result() const {
+            T value = stack.back().first;
+            for (size_t i = stack.size() - 1; i-- > 0;) {
+                value = combine(stack[i].first, value);
+            }
+            return value;
+        }
+    };
+
+    // Sum or product of the body over i = a, a + 1, ... (i <= b)
+    // The range is split into fixed chunks, combined in order, so the result does not depend on threads
+    // Threads take the next chunk when they finish one, if the first chunk shows the others are long enough
+    // At most windowSize chunks wait to be combined, so memory is bounded
+    // NaN if stopped
+    template <class T> T reduce(const BasicCalcProgram <T> &body, const T *params, const T a, const T b, const bool product, const unsigned threads, const CalcStopper *stop) {
+        const size_t chunkSize = 4096;
+        const size_t windowSize = 4096;
+
+        // Indexes are exact up to 2 ^ 53
+        const T maxTerms = 9007199254740992.0;
+
+        if (!(a == a) || !(b == b) || isinf(a) || isinf(b)) {
+            return T(NAN);
+        }
+        if (b < a) {
+            return product ? 1 : 0;
+        }
+
+        const T count = floor(b - a) + 1;
+        if (!(count <= maxTerms)) {
+            return T(NAN);
+        }
+
+        const size_t n = size_t(count);
+        const size_t chunkNum = (n + chunkSize - 1) / chunkSize;
+
+        PairwiseReducer <T> reducer(product);
+        vector <T> results(min(chunkNum, windowSize));
+        vector <char> ready(results.size());
+
+        mutex lock;
+        condition_variable changed;
+
+        // Chunks taken, and combined (in order)
+        size_t next = 0;
+        size_t combined = 0;
+        bool stopped = 0;
+
+        auto runChunk = [&](BodyRunner <T> &f, const size_t chunk) {
+            const size_t begin = chunk * chunkSize;
+            const size_t end = min(n, begin + chunkSize);
+
+            if (product) {
+                T result = 1;
+                for (size_t i = begin; i < end; ++i) {
+                    result *= f(a + T(i));
+                }
+                return result;
+            }
+
+            // Kahan-Babuska summation
+            T result = 0;
+            T compensation = 0;
+            for (size_t i = begin; i < end; ++i) {
+                const T value = f(a + T(i));
+                const T sum = result + value;
+
+                if (abs(result) >= abs(value)) {
+                    compensation += (result - sum) + value;
+                } else {
+                    compensation += (value - sum) + result;
+                }
+                result = sum;
+            }
+            return result + compensation;
+        };
+
+        // Take chunks before last, waiting for room in the window
+        auto work = [&](const size_t last) {
+            BodyRunner <T> f(body, params, stop);
+            unique_lock <mutex> guard(lock);
+
+            while (1) {
+                changed.wait(guard, [&]() {
+                    return next >= last || stopped || next < combined + results.size();
+                });
+                if (next >= last || stopped) {
+                    break;
+                }
+
+                const size_t chunk = next++;
+                guard.unlock();
+
+                const bool running = !f.stopped();
+                const T result = running ? runChunk(f, chunk) : T(NAN);
+
+                guard.lock();
+                if (!running) {
+                    stopped = 1;
+                } else {
+                    results[chunk % results.size()] = result;
+                    ready[chunk % results.size()] = 1;
+
+                    while (combined < next && ready[combined % results.size()]) {
+                        reducer.push(results[combined % results.size()]);
+                        ready[combined % results.size()] = 0;
+                        ++combined;
+                    }
+                }
+                changed.notify_all();
+            }
+        };
+
+        // The first chunk estimates the work of the others
+        const auto begin = chrono::steady_clock::now();
+        work(1);
+        const chrono::duration <double> elapsed = chrono::steady_clock::now() - begin;
+
+        const unsigned threadNum = elapsed.count() * (chunkNum - 1) >= parallelSeconds
+            ? max(unsigned(min(size_t(threads), chunkNum - 1)), 1u) : 1;
+        runThreads(threadNum, [&](const unsigned) {
+            work(chunkNum);
+        });
+
+        return stopped ? T(NAN) : reducer.result();
+    }
+
+    template <class T> T BasicCalcProgram <T>::run(const T *params, T *stack, const unsigned threads, const CalcStopper *stop) const {
+        // Point to the next free slot
+        T *top = stack;
+
+        for (size_t i = 0; i < opers.size(); ++i) {
+            const BasicProgOper <T> &oper = opers[i];
+
+            switch (oper.kind) {
+            case poNum:
+                *top++ = oper.value;
+                break;
+            case poParam:
+                *top++ = params[oper.index];
+                break;
+            case poBi:
+                --top;
+                top[-1] = calcBi(BiOperType(oper.type), top[-1], top[0]);
+                break;
+            case poMono:
+                top[-1] = calcMono(MonoOperType(oper.type), top[-1]);
+                break;
+            case poFunc:
+                top[-1] = calcFunc(FuncType(oper.type), top[-1]);
+                break;
+            case poCall:
+                switch (CallType(oper.type)) {
+                case ctIntegrate:
+                    --top;
+                    top[-1] = integrate(*bodies[oper.index], params, top[-1], top[0], threads, stop);
+                    break;
+                case ctSolve:
+                    top[-1] = solve(*bodies[oper.index], params, top[-1], stop);
+                    break;
+                case ctSum:
+                case ctProd:
+                    --top;
+                    top[-1] = reduce(*bodies[oper.index], params, top[-1], top[0], oper.type == ctProd, threads, stop);
+                    break;
+                }
+                break;
+            case poCond:
+                // Go to the second branch if false
+                --top;
+                if (*top == 0) {
+                    i = oper.index - 1;
+                }
+                break;
+            case poJump:
+                // Skip the second branch
+                i = oper.index - 1;
+                break;
+            case poSelect:
+                // Only one branch is run
+                break;
+            }
+        }
+
+        return stack[0];
+    }
+
+    template <class T> T BasicCalcProgram <T>::run(const vector <T> &params, const unsigned threads, const CalcStopper *stop) const {
+        check(params.size() == paramNum, "Wrong number of parameters");
+
+        vector <T> stack(depth);
+        return run(params.data(), stack.data(), threads, stop);
+    }
+
+    // Calculate function type on rows set in mask (nullptr for all), packing them in packed if not all are
+    template <class T> void calcMaskedFuncs(
+        const FuncType type, const T *a, T *result, const char *mask, const size_t size, T *packed, const FuncMode mode
+    ) {
+        const size_t taken = mask ? count(mask, mask + size, char(1)) : size;
+
+        if (taken == size) {
+            calcFuncs(type, a, result, size, mode);
+        } else if (taken > 0) {
+            size_t m = 0;
+            for (size_t i = 0; i < size; ++i) {
+                if (mask[i]) {
+                    packed[m++] = a[i];
+                }
+            }
+
+            calcFuncs(type, packed, packed, m, mode);
+
+            m = 0;
+            for (size_t i = 0; i < size; ++i) {
+                if (mask[i]) {
+                    result[i] = packed[m++];
+                }
+            }
+        }
+    }
+
+    template <class T> void BasicCalcProgram <T>::runColumns(const T * const *params, T *results, const size_t n, const FuncMode mode) const {
+        const size_t blockSize = 256;
+
+        // Stack of columns, each has blockSize values
+        vector <T> stack(depth * blockSize);
+        vector <T> row(paramNum);
+        vector <T> packed(blockSize);
+
+        // Rows taken by the branches being run, blockSize for each nested branch
+        // The first blockSize are all rows
+        vector <char> masks;
+
+        for (size_t begin = 0; begin < n; begin += blockSize) {
+            const size_t size = min(blockSize, n - begin);
+
+            // Point to the next free column
+            T *top = stack.data();
+
+            masks.assign(blockSize, 1);
+
+            // Start a branch (the second if second) of the condition cond
+            // Return the number of rows taking it
+            auto branch = [&](const T *cond, const bool second) {
+                const char *outer = masks.data() + masks.size() - 2 * blockSize;
+                char *mask = &masks[masks.size() - blockSize];
+
+                size_t taken = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    mask[i] = outer[i] & char((cond[i] != 0) != second);
+                    taken += mask[i];
+                }
+                return taken;
+            };
+
+            for (size_t index = 0; index < opers.size(); ++index) {
+                const BasicProgOper <T> &oper = opers[index];
+
+                switch (oper.kind) {
+                case poNum:
+                    fill(top, top + size, oper.value);
+                    top += blockSize;
+                    break;
+                case poParam:
+                    copy(params[oper.index] + begin, params[oper.index] + begin + size, top);
+                    top += blockSize;
+                    break;
+                case poBi:
+                    top -= blockSize;
+                    calcBis(BiOperType(oper.type), top - blockSize, top, top - blockSize, size);
+                    break;
+                case poMono:
+                    calcMonos(MonoOperType(oper.type), top - blockSize, top - blockSize, size);
+                    break;
+                case poFunc:
+                    // Only rows taking the branches being run
+                    calcMaskedFuncs(
+                        FuncType(oper.type), top - blockSize, top - blockSize, masks.data() + masks.size() - blockSize,
+                        size, packed.data(), mode
+                    );
+                    break;
+                case poCall:
+                    // One row at a time, only rows taking the branches being run
+                    if (CallType(oper.type) != ctSolve) {
+                        top -= blockSize;
+                    }
+
+                    {
+                        const char *mask = masks.data() + masks.size() - blockSize;
+
+                        for (size_t i = 0; i < size; ++i) {
+                            if (!mask[i]) {
+                                continue;
+                            }
+
+                            for (size_t j = 0; j < paramNum; ++j) {
+                                row[j] = params[j][begin + i];
+                            }
+
+                            T &value = (top - blockSize)[i];
+                            switch (CallType(oper.type)) {
+                            case ctIntegrate:
+                                value = integrate(*bodies[oper.index], row.data(), value, top[i], 1, nullptr);
+                                break;
+                            case ctSolve:
+                                value = solve(*bodies[oper.index], row.data(), value, nullptr);
+                                break;
+                            case ctSum:
+                            case ctProd:
+                                value = reduce(*bodies[oper.index], row.data(), value, top[i], oper.type == ctProd, 1, nullptr);
+                                break;
+                            }
+                        }
+                    }
+                    break;
+                case poCond:
+                    // The condition stays on stack
+                    masks.resize(masks.size() + blockSize);
+                    if (branch(top - blockSize, 0) == 0) {
+                        // No row takes the first branch, leave an unused column for it
+                        top += blockSize;
+                        index = oper.index - 1;
+
+                        if (branch(top - 2 * blockSize, 1) == 0) {
+                            // Neither, skip to poSelect
+                            top += blockSize;
+                            index = opers[index].index - 1;
+                        }
+                    }
+                    break;
+                case poJump:
+                    // After the first branch, start the second
+                    if (branch(top - 2 * blockSize, 1) == 0) {
+                        top += blockSize;
+                        index = oper.index - 1;
+                    }
+                    break;
+                case poSelect:
+                    masks.resize(masks.size() - blockSize);
+
+                    // Columns of the condition and both branches
+                    top -= 2 * blockSize;
+                    {
+                        T *cond = top - blockSize;
+                        const T *first = top;
+                        const T *second = top + blockSize;
+
+                        for (size_t i = 0; i < size; ++i) {
+                            cond[i] = cond[i] != 0 ? first[i] : second[i];
+                        }
+                    }
+                    break;
+                }
+            }
+
+            copy(stack.begin(), stack.begin() + size, results + begin);
+        }
+    }
+
+    template <class T> void BasicCalcProgram <T>::save(SnapWriter &writer) const {
+        writer.putInt(paramNum);
+
+        writer.putInt(bodies.size());
+        for (const PBasicCalcProgram <T> &body: bodies) {
+            body->save(writer);
+        }
+
+        writer.putInt(opers.size());
+        for (const BasicProgOper <T> &oper: opers) {
+            writer.putInt(oper.kind);
+            writer.putInt(oper.type);
+            writer.putInt(oper.index);
+            writer.putData(double(oper.value));
+        }
+    }
+
+    template <class T> PBasicCalcProgram <T> BasicCalcProgram <T>::load(SnapReader &reader) {
+        PBasicCalcProgram <T> result(new BasicCalcProgram <T> (reader.getInt()));
+
+        const size_t bodyNum = reader.getCount(3);
+        for (size_t i = 0; i < bodyNum; ++i) {
+            result->bodies.push_back(load(reader));
+            check(result->bodies.back()->paramNum == result->paramNum + 1, "Bad snapshot");
+        }
+
+        const size_t operNum = reader.getCount(4);
+        for (size_t i = 0; i < operNum; ++i) {
+            BasicProgOper <T> oper;
+            oper.kind = ProgOperType(reader.getInt());
+            oper.type = int(reader.getInt());
+            oper.index = reader.getInt();
+            oper.value = T(reader.getData());
+
+            // Check types and indexes, the stack is checked by push()
+            size_t popNum = 0;
+            switch (oper.kind) {
+            case poNum:
+                break;
+            case poParam:
+                check(oper.index < result->paramNum, "Bad snapshot");
+                break;
+            case poBi:
+                check(oper.type >= otAdd && oper.type <= otOr, "Bad snapshot");
+                popNum = 2;
+                break;
+            case poMono:
+                check(oper.type >= mtPos && oper.type <= mtFac, "Bad snapshot");
+                popNum = 1;
+                break;
+            case poFunc:
+                check(oper.type >= ftSin && oper.type <= ftInt, "Bad snapshot");
+                popNum = 1;
+                break;
+            case poCall:
+                check(oper.type >= ctIntegrate && oper.type <= ctProd, "Bad snapshot");
+                check(oper.index < result->bodies.size(), "Bad snapshot");
+                popNum = oper.type == ctSolve ? 1 : 2;
+                break;
+            case poCond:
+            case poJump:
+                popNum = 1;
+                break;
+            case poSelect:
+                popNum = 3;
+                break;
+            default:
+                error("Bad snapshot");
+            }
+
+            result->push(oper, popNum);
+        }
+
+        check(result->size == 1, "Bad snapshot");
+
+        // Check that conditionals are nested and jump to their own parts
+        vector <size_t> conds;
+        for (size_t i = 0; i < operNum; ++i) {
+            const BasicProgOper <T> &oper = result->opers[i];
+
+            switch (oper.kind) {
+            case poCond:
+                conds.push_back(i);
+                break;
+            case poJump:
+                check(!conds.empty() && result->opers[conds.back()].index == i + 1, "Bad snapshot");
+                conds.back() = i;
+                break;
+            case poSelect:
+                check(!conds.empty() && result->opers[conds.back()].kind == poJump, "Bad snapshot");
+                check(result->opers[conds.back()].index == i, "Bad snapshot");
+                conds.pop_back();
+                break;
+            default:
+                break;
+            }
+        }
+        check(conds.empty(), "Bad snapshot");
+
+        return result;
+    }
+
+    template <class T> BasicCalcPlan <T>::BasicCalcPlan(const vector <PBasicCalcProgram <T>> &programs) {
+        programNum = programs.size();
+        if (programNum) {
+            paramNum = programs[0]->paramNum;
+        }
+
+        // Nodes by the bytes of their operation and operands
+        unordered_map <string, size_t> found;
+
+        // Find or add a node
+        auto add = [&](Node node) {
+            string key((const char *) &node.kind, sizeof(node.kind));
+            key.append((const char *) &node.type, sizeof(node.type));
+            key.append((const char *) &node.index, sizeof(node.index));
+            key.append((const char *) node.args, sizeof(size_t) * node.argNum);
+            if (node.kind == poNum) {
+                key.append((const char *) &node.value, sizeof(node.value));
+            }
+
+            const auto iter = found.find(key);
+            if (iter != found.end()) {
+                return iter->second;
+            }
+
+            nodes.push_back(node);
+            found[key] = nodes.size() - 1;
+            return nodes.size() - 1;
+        };
+
+        // Bodies by address, as equal bodies are compiled to different programs
+        map <const BasicCalcProgram <T> *, size_t> bodyIndex;
+
+        for (size_t i = 0; i < programNum; ++i) {
+            const BasicCalcProgram <T> &program = *programs[i];
+            check(program.paramNum == paramNum, "Wrong number of parameters");
+
+            operNum += program.opers.size();
+
+            // Nodes of the stack
+            vector <size_t> stack;
+
+            for (const BasicProgOper <T> &oper: program.opers) {
+                Node node = {oper.kind, oper.type, 0, 0, {0, 0, 0}, 0, 0, {}};
+
+                // Pop operands into args
+                auto pop = [&](const size_t n) {
+                    node.argNum = n;
+                    for (size_t j = n; j > 0; --j) {
+                        node.args[j - 1] = stack.back();
+                        stack.pop_back();
+                    }
+                };
+
+                switch (oper.kind) {
+                case poNum:
+                    node.value = oper.value;
+                    break;
+                case poParam:
+                    node.index = oper.index;
+                    break;
+                case poBi:
+                    pop(2);
+
+                    // Same operation, with operands in order
+                    if (node.type == otIMul) {
+                        node.type = otMul;
+                    }
+                    if ((node.type == otAdd || node.type == otMul || node.type == otEqual || node.type == otNotEqual)
+                        && node.args[0] > node.args[1]) {
+                        swap(node.args[0], node.args[1]);
+                    }
+                    break;
+                case poMono:
+                case poFunc:
+                    pop(1);
+                    break;
+                case poCall:
+                    pop(CallType(oper.type) == ctSolve ? 1 : 2);
+                    {
+                        const BasicCalcProgram <T> *body = program.bodies[oper.index].get();
+                        if (bodyIndex.find(body) == bodyIndex.end()) {
+                            bodyIndex[body] = bodies.size();
+                            bodies.push_back(program.bodies[oper.index]);
+                        }
+                        node.index = bodyIndex[body];
+                    }
+                    break;
+                case poCond:
+                case poJump:
+                    // The condition and the first branch stay on stack
+                    continue;
+                case poSelect:
+                    pop(3);
+                    break;
+                }
+
+                stack.push_back(add(node));
+            }
+
+            check(stack.size() == 1, "Bad program");
+            nodes[stack.back()].outputs.push_back(i);
+        }
+
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (size_t j = 0; j < nodes[i].argNum; ++j) {
+                nodes[nodes[i].args[j]].users.push_back({i, j});
+            }
+        }
+
+        // Users are after the node
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node &node = nodes[i];
+
+            node.always = !node.outputs.empty();
+            for (const auto &user: node.users) {
+                if (nodes[user.first].always && (nodes[user.first].kind != poSelect || user.second == 0)) {
+                    node.always = 1;
+                }
+            }
+        }
+
+        // Last use of each node, itself if only an output
+        vector <size_t> lastUse(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            lastUse[i] = i;
+            for (size_t j = 0; j < nodes[i].argNum; ++j) {
+                lastUse[nodes[i].args[j]] = i;
+            }
+        }
+
+        // Give columns to nodes, parameters are read in place
+        vector <size_t> freeSlots;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            Node &node = nodes[i];
+
+            if (node.kind != poParam) {
+                if (freeSlots.empty()) {
+                    node.slot = slotNum++;
+                } else {
+                    node.slot = freeSlots.back();
+                    freeSlots.pop_back();
+                }
+            }
+
+            // Free after this node, as operands may be the same node
+            vector <size_t> frees;
+            for (size_t j = 0; j < node.argNum; ++j) {
+                const Node &arg = nodes[node.args[j]];
+                if (lastUse[node.args[j]] == i && arg.kind != poParam
+                    && find(frees.begin(), frees.end(), arg.slot) == frees.end()) {
+                    frees.push_back(arg.slot);
+                }
+            }
+            if (lastUse[i] == i && node.kind != poParam) {
+                frees.push_back(node.slot);
+            }
+
+            freeSlots.insert(freeSlots.end(), frees.begin(), frees.end());
+        }
+    }
+
+    template <class T> const char *BasicCalcPlan <T>::findNeed(
+        const size_t index, const size_t before, const vector <const T *> &columns, const size_t size,
+        vector <char> &need, vector <size_t> &found
+    ) const {
+        const size_t blockSize = need.size() / nodes.size();
+        char *mask = &need[index * blockSize];
+
+        if (found[index] > before) {
+            return mask;
+        }
+
+        const Node &node = nodes[index];
+        fill(mask, mask + size, char(node.always || !node.outputs.empty()));
+
+        if (node.always) {
+            found[index] = nodes.size() + 1;
+            return mask;
+        }
+
+        // Until the first condition not calculated yet
+        size_t until = nodes.size();
+
+        for (const auto &user: node.users) {
+            const Node &userNode = nodes[user.first];
+            const char *userMask = findNeed(user.first, before, columns, size, need, found);
+            until = min(until, found[user.first] - 1);
+
+            if (userNode.kind == poSelect && user.second > 0 && userNode.args[0] < before) {
+                // A branch, needed by rows taking it
+                const T *cond = columns[userNode.args[0]];
+                const bool second = user.second == 2;
+
+                for (size_t i = 0; i < size; ++i) {
+                    mask[i] |= userMask[i] & char((cond[i] != 0) != second);
+                }
+            } else {
+                if (userNode.kind == poSelect && user.second > 0) {
+                    until = min(until, userNode.args[0]);
+                }
+                for (size_t i = 0; i < size; ++i) {
+                    mask[i] |= userMask[i];
+                }
+            }
+        }
+
+        found[index] = until + 1;
+        return mask;
+    }
+
+    template <class T> void BasicCalcPlan <T>::runColumns(const T * const *params, T * const *results, const size_t n, const FuncMode mode) const {
+        const size_t blockSize = 256;
+
+        vector <T> slots(slotNum * blockSize);
+        vector <const T *> columns(nodes.size());
+        vector <T> row(paramNum);
+        vector <T> packed(blockSize);
+
+        // Rows needing each node
+        vector <char> need(nodes.size() * blockSize);
+        vector <size_t> found(nodes.size());
+
+        for (size_t begin = 0; begin < n; begin += blockSize) {
+            const size_t size = min(blockSize, n - begin);
+
+            fill(found.begin(), found.end(), 0);
+
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                const Node &node = nodes[i];
+
+                if (node.kind == poParam) {
+                    columns[i] = params[node.index] + begin;
+                } else {
+                    T *target = slots.data() + node.slot * blockSize;
+                    const T *a = node.argNum > 0 ? columns[node.args[0]] : nullptr;
+                    const T *b = node.argNum > 1 ? columns[node.args[1]] : nullptr;
+                    const T *c = node.argNum > 2 ? columns[node.args[2]] : nullptr;
+
+                    const char *mask = node.always ? nullptr : findNeed(i, i, columns, size, need, found);
+
+                    columns[i] = target;
+
+                    // Not needed by any row, as only in branches not taken
+                    if (mask && find(mask, mask + size, char(1)) == mask + size) {
+                        continue;
+                    }
+
+                    switch (node.kind) {
+                    case poNum:
+                        fill(target, target + size, node.value);
+                        break;
+                    case poBi:
+                        calcBis(BiOperType(node.type), a, b, target, size);
+                        break;
+                    case poMono:
+                        calcMonos(MonoOperType(node.type), a, target, size);
+                        break;
+                    case poFunc:
+                        calcMaskedFuncs(FuncType(node.type), a, target, mask, size, packed.data(), mode);
+                        break;
+                    case poCall:
+                        // One row at a time, only rows needing it
+                        for (size_t k = 0; k < size; ++k) {
+                            if (mask && !mask[k]) {
+                                continue;
+                            }
+
+                            for (size_t j = 0; j < paramNum; ++j) {
+                                row[j] = params[j][begin + k];
+                            }
+
+                            const BasicCalcProgram <T> &body = *bodies[node.index];
+                            switch (CallType(node.type)) {
+                            case ctIntegrate:
+                                target[k] = integrate(body, row.data(), a[k], b[k], 1, nullptr);
+                                break;
+                            case ctSolve:
+                                target[k] = solve(body, row.data(), a[k], nullptr);
+                                break;
+                            case ctSum:
+                            case ctProd:
+                                target[k] = reduce(body, row.data(), a[k], b[k], node.type == ctProd, 1, nullptr);
+                                break;
+                            }
+                        }
+                        break;
+                    case poSelect:
+                        for (size_t k = 0; k < size; ++k) {
+                            target[k] = a[k] != 0 ? b[k] : c[k];
+                        }
+                        break;
+                    default:
+                        break;
+                    }
+                }
+
+                for (const size_t output: node.outputs) {
+                    copy(columns[i], columns[i] + size, results[output] + begin);
+                }
+            }
+        }
+    }
+
+    template class BasicCalcProgram <float>;
+    template class BasicCalcProgram <double>;
+    template class BasicCalcProgram <long double>;
+#if defined(CALC_FLOAT128)
+    template class BasicCalcProgram <CalcQuad>;
+#endif
+
+    template class BasicCalcPlan <float>;
+    template class BasicCalcPlan <double>;
+    template class BasicCalcPlan <long double>;
+#if defined(CALC_FLOAT128)
+    template class BasicCalcPlan <CalcQuad>;
+#endif
+
+    unsigned calcThreads() {
+        const unsigned result = thread::hardware_concurrency();
+        return result ? result : 1;
+    }
+}
@@ -0,0 +1,203 @@
+#ifndef __INC_CALCPROG_HPP__
+#define __INC_CALCPROG_HPP__
+
+#include "opcalcrule.hpp"
+#include "opcalcfast.hpp"
+#include "opcalcsnap.hpp"
+
+namespace OPParser {
+    // T is the value type: float, double, long double or __float128
+    template <class T> class BasicCalcProgram;
+    template <class T> class BasicCalcPlan;
+
+    // Use pointer instead of reference
+    template <class T> using PBasicCalcProgram = shared_ptr <BasicCalcProgram <T>>;
+
+    // Stops long calls (integrate, sum and prod) of running programs, see Parser::budget
+    // Checked every few runs of a body, by any thread
+    struct CalcStopper {
+        // Stop if set, nullptr for none
+        const atomic <bool> *cancel = nullptr;
+
+        // Stop after the deadline, if timed
+        bool timed = 0;
+        chrono::steady_clock::time_point deadline = {};
+
+        bool stopped() const {
+            return (cancel != nullptr && cancel->load(memory_order_relaxed))
+                || (timed && chrono::steady_clock::now() > deadline);
+        }
+    };
+
+    // Operations of programs
+    // poCond, poJump and poSelect make "cond ? a : b", as cond poCond a poJump b poSelect
+    enum ProgOperType {poNum, poParam, poBi, poMono, poFunc, poCall, poCond, poJump, poSelect};
+
+    // An operation, in postfix order
+    template <class T> struct BasicProgOper {
+        ProgOperType kind;
+
+        // BiOperType, MonoOperType, FuncType or CallType
+        int type;
+
+        // Index of parameter (poParam), body (poCall) or operation to jump to (poCond, poJump)
+        size_t index;
+
+        // Value of number (poNum)
+        T value;
+    };
+
+    // Compiled expression, a function of parameters
+    // Can be run many times (and from many threads) without parsing
+    template <class T> class BasicCalcProgram {
+    protected:
+        vector <BasicProgOper <T>> opers = {};
+
+        // Bodies of calls, with an extra parameter
+        vector <PBasicCalcProgram <T>> bodies = {};
+
+        size_t paramNum = 0;
+
+        // Stack size now and the max stack size, for building
+        size_t size = 0;
+        size_t depth = 0;
+
+        // Push an operation
+        void push(const BasicProgOper <T> &oper, const size_t popNum);
+
+        // If the last n operations are numbers, get them
+        bool lastNums(const size_t n, T *values) const;
+    public:
+        friend class BasicCalcPlan <T>;
+
+        BasicCalcProgram(const size_t toParamNum): paramNum(toParamNum) {}
+
+        size_t getParamNum() const {
+            return paramNum;
+        }
+
+        // Stack size needed by run()
+        size_t getDepth() const {
+            return depth;
+        }
+
+        // Build the program
+        // Operations on numbers are folded
+        void pushNum(const T value);
+        void pushParam(const size_t index);
+        void pushBi(const BiOperType type);
+        void pushMono(const MonoOperType type);
+        void pushFunc(const FuncType type);
+
+        // Call with a body which has an extra parameter
+        // Arguments (other than the body) should be pushed before
+        void pushCall(const CallType type, const PBasicCalcProgram <T> body);
+
+        // Conditional, only the branch taken is run
+        // Call pushCond() after the condition, pushElse() after the first branch
+        // and pushSelect() after the second branch, with what the last one returned
+        size_t pushCond();
+        size_t pushElse(const size_t condIndex);
+        void pushSelect(const size_t elseIndex);
+
+        // Run the program
+        // Stack should have getDepth() elements
+        // Calls may use up to threads threads (including this), if long enough to pay for them
+        // Calls return NaN if stopped by stop (nullptr for none)
+        T run(const T *params, T *stack, const unsigned threads = 1, const CalcStopper *stop = nullptr) const;
+
+        // Run the program
+        T run(const vector <T> &params, const unsigned threads = 1, const CalcStopper *stop = nullptr) const;
+
+        // Run the program over n rows, an operation over many rows at a time
+        // Branches of conditionals are run if any row of a block takes them, then selected
+        // Functions and calls only run rows taking the branches
+        // params[i] points to n values of parameter i, results gets n values
+        // Functions are calculated in mode (see calcFuncs)
+        void runColumns(const T * const *params, T *results, const size_t n, const FuncMode mode = fmExact) const;
+
+        // Write to a snapshot, values are saved as double
+        void save(SnapWriter &writer) const;
+
+        // Read from a snapshot, operations are checked but not folded again
+        static PBasicCalcProgram <T> load(SnapReader &reader);
+    };
+
+    // Many programs of the same parameters, run together over columns
+    // Operations on the same operands are calculated once, across the programs
+    // Nodes no row of a block needs (only in branches not taken) are skipped
+    // Functions and calls only run rows needing them, other operations run the whole block
+    template <class T> class BasicCalcPlan {
+    protected:
+        // An operation on earlier nodes
+        // poSelect has the condition and both branches as operands
+        struct Node {
+            ProgOperType kind;
+            int type;
+
+            // Index of parameter (poParam) or body (poCall)
+            size_t index;
+
+            // Value of number (poNum)
+            T value;
+
+            size_t args[3];
+            size_t argNum;
+
+            // Column of the result, reused after the last use
+            size_t slot;
+
+            // Programs returning this node
+            vector <size_t> outputs;
+
+            // Nodes using this, and the index of the operand
+            vector <pair <size_t, size_t>> users;
+
+            // Needed by all rows, not only in branches
+            bool always;
+        };
+
+        vector <Node> nodes = {};
+        vector <PBasicCalcProgram <T>> bodies = {};
+
+        size_t paramNum = 0;
+        size_t programNum = 0;
+        size_t slotNum = 0;
+        size_t operNum = 0;
+
+        // Rows of a block needing node index, in need (blockSize for each node)
+        // Rows of branches not taken are not needed, if the condition is before node before (calculated)
+        // found[i] - 1 is the first condition node i's rows did not use, 0 if not found
+        const char *findNeed(
+            const size_t index, const size_t before, const vector <const T *> &columns, const size_t size,
+            vector <char> &need, vector <size_t> &found
+        ) const;
+    public:
+        // Programs should have the same number of parameters
+        BasicCalcPlan(const vector <PBasicCalcProgram <T>> &programs);
+
+        // Operations of the programs, before merging
+        size_t getOperNum() const {
+            return operNum;
+        }
+
+        // Operations after merging
+        size_t getNodeNum() const {
+            return nodes.size();
+        }
+
+        // Run the programs over n rows, see BasicCalcProgram::runColumns()
+        // params[i] points to n values of parameter i, results[j] gets n values of program j
+        void runColumns(const T * const *params, T * const *results, const size_t n, const FuncMode mode = fmExact) const;
+    };
+
+    typedef BasicProgOper <CalcData> ProgOper;
+    typedef BasicCalcProgram <CalcData> CalcProgram;
+    typedef PBasicCalcProgram <CalcData> PCalcProgram;
+    typedef BasicCalcPlan <CalcData> CalcPlan;
+
+    // Get the number of threads to use
+    unsigned calcThreads();
+}
+
+#endif
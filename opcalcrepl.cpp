@@ -1,4 +1,10 @@
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
 #include "opcalcrepl.hpp"
+#include "opcalcscan.hpp"
 
 namespace OPParser {
     // Semicolon
@@ -18,15 +24,410 @@ namespace OPParser {
         }
     };
 
-    void CalcRepl::addLastLexers() {
+    // A ";"-separated statement
+    struct CalcStatement {
+        Input text = "";
+
+        // Blank statement prints and writes nothing
+        bool blank = 1;
+
+        // Names read and written (by assignations and ans)
+        vector <Input> reads = {};
+        vector <Input> writes = {};
+
+        // Statements writing the names read, or -1 if none
+        vector <size_t> writers = {};
+
+        // Level in the dependency graph
+        size_t level = 0;
+
+        // Constants and variables, only names read
+        // After running, contains names written
+        map <Input, CalcData> consts = {};
+
+        // Result
+        Output output = "";
+        bool failed = 0;
+    };
+
+    // Split input and find names
+    // Return false if a ";" is in brackets
+    bool splitStatements(const Input &input, vector <CalcStatement> &statements) {
+        statements.push_back(CalcStatement());
+
+        int depth = 0;
+        bool assign = 0;
+        for (InputIter now = input.begin(); now != input.end();) {
+            CalcStatement &statement = statements.back();
+            const int cls = charClass(*now);
+
+            if (cls & ccAlpha) {
+                const InputIter begin = now;
+                now = scanRun(now, input.end(), ccAlpha | ccDigit);
+                const Input name(begin, now);
+
+                statement.text += name;
+                statement.blank = 0;
+
+                if (assign) {
+                    statement.writes.push_back(name);
+                } else if (GetFunc.find(name) == GetFunc.end() && GetCall.find(name) == GetCall.end()) {
+                    statement.reads.push_back(name);
+                }
+                assign = 0;
+                continue;
+            }
+
+            if (*now == ';') {
+                if (depth != 0) {
+                    return 0;
+                }
+
+                statements.push_back(CalcStatement());
+                assign = 0;
+                ++now;
+                continue;
+            }
+
+            if (*now == '-' && now + 1 != input.end() && *(now + 1) == '>') {
+                assign = 1;
+            } else if (*now == '(') {
+                ++depth;
+            } else if (*now == ')') {
+                --depth;
+            }
+
+            if (!(cls & ccBlank)) {
+                statement.blank = 0;
+            }
+            statement.text += *now;
+            ++now;
+        }
+
+        return 1;
+    }
+
+    bool CalcRepl::parseParallel(const Input &input) {
+        vector <CalcStatement> statements;
+        if (threads < 2 || !splitStatements(input, statements) || statements.size() < 2) {
+            return 0;
+        }
+
+        // Find the statement writing each name last, and the levels
+        map <Input, size_t> writers;
+        vector <vector <size_t> > levels;
+
+        for (size_t i = 0; i < statements.size(); ++i) {
+            CalcStatement &statement = statements[i];
+            if (statement.blank) {
+                continue;
+            }
+
+            // Names written are read too, as they keep the value before if not assigned (in a branch not taken)
+            for (const Input &name: statement.writes) {
+                if (find(statement.reads.begin(), statement.reads.end(), name) == statement.reads.end()) {
+                    statement.reads.push_back(name);
+                }
+            }
+
+            for (const Input &name: statement.reads) {
+                const auto found = writers.find(name);
+
+                if (found != writers.end()) {
+                    statement.writers.push_back(found->second);
+
+                    if (statement.level <= statements[found->second].level) {
+                        statement.level = statements[found->second].level + 1;
+                    }
+                } else {
+                    statement.writers.push_back(-1);
+                }
+            }
+
+            statement.writes.push_back("ans");
+            for (const Input &name: statement.writes) {
+                writers[name] = i;
+            }
+
+            if (levels.size() <= statement.level) {
+                levels.resize(statement.level + 1);
+            }
+            levels[statement.level].push_back(i);
+        }
+
+        // Run statements level by level
+        for (const vector <size_t> &level: levels) {
+            // Get names read
+            // Writers are in earlier levels
+            for (const size_t i: level) {
+                CalcStatement &statement = statements[i];
+
+                for (size_t j = 0; j < statement.reads.size(); ++j) {
+                    const Input &name = statement.reads[j];
+                    const size_t writer = statement.writers[j];
+
+                    if (writer == size_t(-1)) {
+                        const CalcData *value = findConst(name);
+                        if (value != nullptr) {
+                            statement.consts[name] = *value;
+                        }
+                    } else if (!statements[writer].failed) {
+                        // Not there if never assigned
+                        const auto value = statements[writer].consts.find(name);
+                        if (value != statements[writer].consts.end()) {
+                            statement.consts[name] = value->second;
+                        }
+                    } else {
+                        // Never run, as an error is before
+                        statement.failed = 1;
+                    }
+                }
+            }
+
+            atomic <size_t> next(0);
+            mutex timesLock;
+
+            // Threads of calls are split among the workers, so cores are not used many times over
+            const unsigned workerNum = unsigned(min(size_t(threads), level.size()));
+
+            auto work = [&]() {
+                ostringstream output;
+
+                CalcRepl worker;
+                worker.out = &output;
+                worker.nearTolerance = nearTolerance;
+                worker.budget = budget;
+                worker.cancel = cancel;
+                worker.threads = max(threads / workerNum, 1u);
+                worker.init();
+
+                // Times of the worker, added to the REPL's at the end
+                ParseTimes workerTimes;
+                if (timing != nullptr) {
+                    worker.timing = &workerTimes;
+                }
+
+                for (size_t index = next++; index < level.size(); index = next++) {
+                    CalcStatement &statement = statements[level[index]];
+                    if (statement.failed) {
+                        continue;
+                    }
+
+                    output.str("");
+                    worker.consts = &statement.consts;
+
+                    try {
+                        // With ";", to get the same lexer state as the whole line
+                        if (level[index] + 1 == statements.size()) {
+                            worker.parse(statement.text);
+                            worker.write();
+                        } else {
+                            worker.parse(statement.text + ";");
+                        }
+                    } catch (const opparser_error &e) {
+                        statement.failed = 1;
+                        worker.recover();
+                    }
+
+                    statement.output = output.str();
+                }
+
+                if (timing != nullptr) {
+                    lock_guard <mutex> guard(timesLock);
+                    timing->lex += workerTimes.lex;
+                    timing->stack += workerTimes.stack;
+                    timing->math += workerTimes.math;
+                }
+            };
+
+            if (workerNum > 1) {
+                vector <thread> workers;
+                for (unsigned i = 0; i < workerNum; ++i) {
+                    workers.push_back(thread(work));
+                }
+                for (thread &worker: workers) {
+                    worker.join();
+                }
+            } else {
+                work();
+            }
+        }
+
+        // Write results and names in order
+        for (size_t i = 0; i < statements.size(); ++i) {
+            CalcStatement &statement = statements[i];
+            if (statement.blank) {
+                continue;
+            }
+
+            if (statement.failed) {
+                // Run again here, as names may be assigned before the error
+                if (i + 1 == statements.size()) {
+                    parse(statement.text);
+                    write();
+                } else {
+                    parse(statement.text + ";");
+                }
+                continue;
+            }
+
+            (*out)<<statement.output;
+
+            for (const Input &name: statement.writes) {
+                const auto value = statement.consts.find(name);
+                if (value != statement.consts.end()) {
+                    (*consts)[name] = value->second;
+                }
+            }
+        }
+        (*out).flush();
+
+        return 1;
+    }
+
+    // Split "expression -> name -> name" at "->" out of brackets
+    // Return false if not such a chain
+    bool splitChain(const Input &text, Input &expr, vector <Input> &names) {
+        int depth = 0;
+        vector <InputIter> arrows;
+
+        for (InputIter now = text.begin(); now != text.end(); ++now) {
+            if (*now == '(') {
+                ++depth;
+            } else if (*now == ')') {
+                --depth;
+            } else if (*now == '-' && now + 1 != text.end() && *(now + 1) == '>') {
+                if (depth != 0) {
+                    return 0;
+                }
+                arrows.push_back(now);
+            }
+        }
+
+        if (arrows.empty()) {
+            return 0;
+        }
+
+        expr = Input(text.begin(), arrows[0]);
+        arrows.push_back(text.end());
+
+        for (size_t i = 0; i + 1 < arrows.size(); ++i) {
+            InputIter begin = scanRun(arrows[i] + 2, arrows[i + 1], ccBlank);
+            if (begin == arrows[i + 1] || !(charClass(*begin) & ccAlpha)) {
+                return 0;
+            }
+
+            const InputIter end = scanRun(begin, arrows[i + 1], ccAlpha | ccDigit);
+            if (scanRun(end, arrows[i + 1], ccBlank) != arrows[i + 1]) {
+                return 0;
+            }
+
+            names.push_back(Input(begin, end));
+        }
+
+        return 1;
+    }
+
+    void CalcRepl::parseReactive(const Input &input) {
+        vector <CalcStatement> statements;
+        if (!splitStatements(input, statements)) {
+            // Not split, nothing kept
+            parse(input);
+            for (const CalcStatement &statement: statements) {
+                for (const Input &name: statement.writes) {
+                    ownSheet().assign(name, *this);
+                }
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < statements.size(); ++i) {
+            const CalcStatement &statement = statements[i];
+
+            Input expr;
+            vector <Input> names;
+            vector <Input> assigned = statement.writes;
+
+            // The statement to run for the result, ans and names assigned by value
+            Input text = statement.text;
+
+            if (splitChain(statement.text, expr, names)) {
+                assigned.clear();
+
+                // The first name keeps the expression, others follow it
+                for (size_t j = 0; j < names.size(); ++j) {
+                    if (!ownSheet().define(names[j], j ? names[j - 1] : expr, *this)) {
+                        // Circular, assign by value
+                        assigned.push_back(names[j]);
+                    } else if (j == 0) {
+                        // Calculated by define(), read the value instead of calculating again
+                        text = names[0];
+                    }
+                }
+
+                if (text == names[0]) {
+                    for (size_t j = 1; j < names.size(); ++j) {
+                        text += " -> " + names[j];
+                    }
+                }
+            }
+
+            if (i + 1 == statements.size()) {
+                parse(text);
+            } else {
+                parse(text + ";");
+            }
+
+            for (const Input &name: assigned) {
+                ownSheet().assign(name, *this);
+            }
+        }
+    }
+
+    void CalcRepl::addLastLexers(LexerMap &target) {
         {
             PLexer lexer(new GoOnLexer());
             // As number state is unusual
-            lexers[stateNum].push_back(lexer);
-            lexers[stateOper].push_back(lexer);
+            target[stateNum].push_back(lexer);
+            target[stateOper].push_back(lexer);
+        }
+
+        Calc::addLastLexers(target);
+    }
+
+    CalcRepl::CalcRepl() {
+        own = GetConst;
+        consts = &own;
+    }
+
+    CalcSheet &CalcRepl::ownSheet() {
+        if (sheet.use_count() > 1) {
+            sheet.reset(new CalcSheet(*sheet));
+        }
+        return *sheet;
+    }
+
+    void CalcRepl::forkTo(CalcRepl &child) {
+        Calc::forkTo(child);
+
+        child.in = in;
+        child.out = out;
+        child.exitSign = exitSign;
+        child.sheet = sheet;
+        child.parallel = parallel;
+        child.reactive = reactive;
+        child.nearTolerance = nearTolerance;
+        child.stats = stats;
+    }
+
+    void CalcRepl::recordStats() {
+        if (timing == nullptr) {
+            return;
         }
 
-        Calc::addLastLexers();
+        const uint64_t total = chrono::duration_cast <chrono::nanoseconds> (chrono::steady_clock::now() - timedBegin).count();
+        stats->record(timedInput, total, times);
+        timing = nullptr;
     }
 
     void CalcRepl::read() {
@@ -43,9 +444,22 @@ namespace OPParser {
 
         if (input == exitSign) {
             running = 0;
+        } else if (stats != nullptr && input == statsSign) {
+            stats->dump(*out);
         } else {
+            if (stats != nullptr && input != "") {
+                timedInput = input;
+                timedBegin = chrono::steady_clock::now();
+                times = {};
+                timing = &times;
+            }
+
             // Do parsing
-            parse(input);
+            if (reactive) {
+                parseReactive(input);
+            } else if (!parallel || !parseParallel(input)) {
+                parse(input);
+            }
         }
     }
 
@@ -53,26 +467,33 @@ namespace OPParser {
         if (outStack.empty() && midStack.empty()) {
             // Nothing
         } else {
-            CalcData result = finishByData();
+            bool isInt;
+            CalcInt intResult;
+            CalcData result = finishByData(isInt, intResult);
+
+            if (isInt) {
+                // Exact result, no near value
+                (*out)<<"  = "<<intResult<<endl;
+                (*out).flush();
+                return;
+            }
 
             // If not NaN, find near value
             if (result == result) {
-                CalcNearData nearresult = fnear(result);
+                NearMatch match;
 
-                // Find x ~= result
-                const auto found1 = NearValue.find(nearresult);
-                if (found1 != NearValue.end()) {
-                    (*out)<<"  ~ "<<found1->second<<endl;
-                } else {
-                    // Find x ~= -result
-                    const auto found2 = NearValue.find(-nearresult);
-                    if (found2 != NearValue.end()) {
-                        (*out)<<"  ~ "<<"- ("<<found2->second<<")"<<endl;
+                // Find x ~= result or x ~= -result
+                if (nearIndex().find(result, nearTolerance, &match, 1)) {
+                    if (match.negated) {
+                        (*out)<<"  ~ "<<"- ("<<match.entry->text<<")"<<endl;
                     } else {
-                        // Find any ~= result
-                        if (nearresult != (CalcNearData)result) {
-                            (*out)<<"  ~ "<<nearresult<<endl;
-                        }
+                        (*out)<<"  ~ "<<match.entry->text<<endl;
+                    }
+                } else {
+                    // Find any ~= result
+                    CalcNearData nearresult = fnear(result);
+                    if (nearresult != (CalcNearData)result) {
+                        (*out)<<"  ~ "<<nearresult<<endl;
                     }
                 }
             }
@@ -82,6 +503,46 @@ namespace OPParser {
         }
     }
 
+    // Variables of a snapshot, read from it when used
+    class SnapConsts: public CalcSource <CalcData> {
+    protected:
+        shared_ptr <SnapReader> reader;
+        SnapTable table;
+    public:
+        SnapConsts(const shared_ptr <SnapReader> &from): reader(from), table(from->getTable()) {}
+
+        const CalcData *find(const Input &name) const {
+            return table.find(name);
+        }
+
+        void list(map <Input, CalcData> &target) const {
+            table.list(target);
+        }
+    };
+
+    void CalcRepl::save(const Input &path) const {
+        SnapWriter writer;
+
+        writer.putTable(allConsts());
+
+        sheet->save(writer);
+
+        writer.save(path);
+    }
+
+    void CalcRepl::load(const Input &path) {
+        shared_ptr <SnapReader> reader(new SnapReader(path));
+
+        // Only the table is read, the snapshot is kept mapped for the values
+        shared_ptr <const SnapConsts> values(new SnapConsts(reader));
+
+        shared_ptr <CalcSheet> loaded(new CalcSheet());
+        loaded->load(*reader);
+
+        addLayer(values);
+        sheet = loaded;
+    }
+
     void CalcRepl::run(Input exitSign) {
         init();
 
@@ -90,9 +551,12 @@ namespace OPParser {
             try {
                 read();
                 write();
+                recordStats();
             } catch (const opparser_error &e) {
                 (*out)<<"  # "<<e.what()<<endl;
-                init();
+                // Failed expressions are timed too
+                recordStats();
+                recover();
             }
         }
     }
@@ -4,6 +4,8 @@
 #include <iostream>
 #include "opcalc.hpp"
 #include "opcalcnear.hpp"
+#include "opcalcsheet.hpp"
+#include "opcalcstats.hpp"
 
 namespace OPParser {
     // Calculator with REPL
@@ -15,15 +17,71 @@ namespace OPParser {
         string exitSign = "q";
         bool running = 0;
 
+        // Input to dump stats
+        string statsSign = ":stats";
+
+        // The expression being timed, and its time by stage
+        Input timedInput = "";
+        chrono::steady_clock::time_point timedBegin = {};
+        ParseTimes times = {};
+
+        // Record the expression being timed to stats, if any
+        void recordStats();
+
         // Push ";" lexer
-        void addLastLexers();
+        void addLastLexers(LexerMap &target);
+
+        // Run ";"-separated statements in parallel, as if run in sequence
+        // Statements run after the statements writing the names they read
+        // Return false if the input is not suitable, to parse normally
+        bool parseParallel(const Input &input);
+
+        // Names defined by expressions, in reactive mode
+        // Shared by forks until one of them changes it
+        shared_ptr <CalcSheet> sheet = shared_ptr <CalcSheet> (new CalcSheet());
+
+        // The sheet to change, copied first if shared
+        CalcSheet &ownSheet();
+
+        // Run ";"-separated statements, keeping expressions of "->" chains
+        void parseReactive(const Input &input);
     public:
+        // Own constants and variables, starting with GetConst
+        CalcRepl();
+
+        // Try to run statements in parallel
+        bool parallel = 1;
+
+        // Names assigned by "->" chains are recomputed when names they read change
+        bool reactive = 0;
+
+        // Relative tolerance of near values
+        CalcData nearTolerance = 1e-9;
+
+        // Record latency of each expression, from read() to write() in run(), nullptr for none (default)
+        // For statements run in parallel, stages add up the time of all threads
+        // Can be shared by forks on different threads
+        // Input ":stats" to dump it
+        CalcStats *stats = nullptr;
+
         // Read from input stream
         void read();
 
         // Run and write result to output stream
         void write();
 
+        // Make child an independent session, between expressions
+        // It has the same variables, reactive names and settings, see Calc::forkTo()
+        // Forks can run on different threads
+        void forkTo(CalcRepl &child);
+
+        // Save constants, variables and reactive names to a snapshot
+        void save(const Input &path) const;
+
+        // Load a snapshot saved by save()
+        // If failed, nothing is changed
+        void load(const Input &path);
+
         // Run REPL interpreter with input and output stream
         // Input exit sign to exit
         void run(Input exitSign);
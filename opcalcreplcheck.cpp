@@ -0,0 +1,96 @@
+#include <iostream>
+#include <sstream>
+#include "opcalcrepl.hpp"
+
+// Check that ";"-separated statements give the same output in parallel and in sequence
+// Usage: ./replcheck
+
+namespace OPParser {
+    // Run lines in a new REPL, return the output
+    Output runLines(const vector <Input> &lines, const bool parallel) {
+        istringstream input;
+        ostringstream output;
+
+        Input text;
+        for (const Input &line: lines) {
+            text += line + "\n";
+        }
+        text += "q\n";
+        input.str(text);
+
+        class CheckRepl: public CalcRepl {
+        public:
+            CheckRepl(istream &toIn, ostream &toOut) {
+                in = &toIn;
+                out = &toOut;
+            }
+        };
+
+        CheckRepl repl(input, output);
+        repl.parallel = parallel;
+        // Even on one core
+        repl.threads = 4;
+        // Loose, to see near values
+        repl.nearTolerance = 1e-4;
+        repl.run("q");
+
+        return output.str();
+    }
+}
+
+int main() {
+    using namespace std;
+    using namespace OPParser;
+
+    // Many independent statements, then one reading all of them
+    Input longLine;
+    Input total = "0";
+    for (int i = 0; i < 200; ++i) {
+        longLine += to_string(i) + " * " + to_string(i) + " -> v" + to_string(i) + "; ";
+        total += " + v" + to_string(i);
+    }
+    longLine += total;
+
+    // Each case starts with a new REPL
+    const vector <vector <Input> > cases = {
+        {"1; 2; 3"},
+        {"2 -> a; a + 1 -> b; a * b"},
+        {"0 && (5 -> zz); zz"},
+        {"1 || (5 -> zz); zz"},
+        {"1 -> zz", "0 && (5 -> zz); zz"},
+        {"1 -> zz", "0 ? (5 -> zz) : 2; zz + 1"},
+        {"1 > 0 ? (3 -> y) : (4 -> y); y"},
+        {"x; 1"},
+        {"1 -> x; x + 1 -> x; x"},
+        {"sum(i, 1, 10, i) -> s; s / 5; ans"},
+        {"3.1416; 1"},
+
+        // Levels of the dependency analysis: names read, written, and written again
+        {"1 -> a; 2 -> b; a + b -> c; c * 2 -> a; a + c; b"},
+        {"5 -> a; a + 1; 7 -> a; a + 1; a -> b; b"},
+        {"1 -> a; 0 ? (2 -> a) : (3 -> b); a + b"},
+        {"ans; 4; ans * 2; ans + 1"},
+        {"1 -> a; a + foo; a + 1 -> a; a"},
+        {"1 -> a; (a + 1 -> b) * 2; b"},
+        {"sum(i, 1, 100000, i) -> s; prod(i, 1, 10, i); integrate(x, x, 0, 1); s"},
+        {longLine}
+    };
+
+    int failed = 0;
+    for (const vector <Input> &lines: cases) {
+        const Output parallel = runLines(lines, 1);
+        const Output sequence = runLines(lines, 0);
+
+        if (parallel != sequence) {
+            ++failed;
+            cout<<"Different:";
+            for (const Input &line: lines) {
+                cout<<" ["<<line<<"]";
+            }
+            cout<<endl<<"Parallel:"<<endl<<parallel<<endl<<"In sequence:"<<endl<<sequence<<endl;
+        }
+    }
+
+    cout<<cases.size() - failed<<" / "<<cases.size()<<" same"<<endl;
+    return failed ? 1 : 0;
+}
@@ -1,7 +1,7 @@
 #include "opcalcrule.hpp"
 
 namespace OPParser {
-    map <Input, FuncType> GetFunc = {
+    const map <Input, FuncType> GetFunc = {
         {"sin", ftSin}, {"cos", ftCos}, {"tan", ftTan}, {"asin", ftASin}, {"acos", ftACos}, {"atan", ftATan},
         {"sinh", ftSinH}, {"cosh", ftCosH}, {"tanh", ftTanH}, {"asinh", ftASinH}, {"acosh", ftACosH}, {"atanh", ftATanH},
         {"log", ftLog}, {"log10", ftLog10}, {"log2", ftLog2}, {"sqr", ftSqr}, {"sqrt", ftSqrt}, {"abs", ftAbs}, {"sign", ftSign},
@@ -9,7 +9,166 @@ namespace OPParser {
         {"ceil", ftCeil}, {"floor", ftFloor}, {"trunc", ftTrunc}, {"round", ftRound}, {"int", ftInt}
     };
 
+    const map <Input, CallType> GetCall = {
+        {"integrate", ctIntegrate}, {"solve", ctSolve}, {"sum", ctSum}, {"prod", ctProd}
+    };
+
     map <Input, CalcData> GetConst = {
         {"pi", M_PI}, {"e", M_E}, {"tau", 2 * M_PI}, {"phi", (sqrt(5) - 1) / 2}, {"inf", INFINITY}, {"nan", NAN}, {"ans", 0}
     };
+
+    template <class T> map <Input, T> &getConsts() {
+        // Built once, in the precision of T
+        static map <Input, T> result = {
+            {"pi", calcPi <T> ()}, {"e", exp(T(1))}, {"tau", 2 * calcPi <T> ()}, {"phi", (sqrt(T(5)) - 1) / 2},
+            {"inf", T(INFINITY)}, {"nan", T(NAN)}, {"ans", 0}
+        };
+        return result;
+    }
+
+    template <> map <Input, CalcData> &getConsts <CalcData> () {
+        return GetConst;
+    }
+
+    template <class T> T calcBi(const BiOperType type, const T left, const T right) {
+        switch (type) {
+        case otAdd:
+            return left + right;
+        case otSub:
+            return left - right;
+        case otMul:
+        case otIMul:
+            return left * right;
+        case otDiv:
+            return left / right;
+        case otMod:
+            return fmod(left, right);
+        case otPwr:
+            return pow(left, right);
+        case otLess:
+            return left < right;
+        case otLessEq:
+            return left <= right;
+        case otGreater:
+            return left > right;
+        case otGreaterEq:
+            return left >= right;
+        case otEqual:
+            return left == right;
+        case otNotEqual:
+            return left != right;
+        case otAnd:
+            return left != 0 && right != 0;
+        case otOr:
+            return left != 0 || right != 0;
+        }
+
+        // Never reach
+        return NAN;
+    }
+
+    template <class T> T calcMono(const MonoOperType type, const T target) {
+        switch (type) {
+        case mtPos:
+            return target;
+        case mtNeg:
+            return -target;
+        case mtFac:
+            // x! == gamma(x + 1)
+            return tgamma(target + 1);
+        }
+
+        // Never reach
+        return NAN;
+    }
+
+    template <class T> T calcFunc(const FuncType type, const T target) {
+        switch (type) {
+        case ftSin:
+            return sin(target);
+        case ftCos:
+            return cos(target);
+        case ftTan:
+            return tan(target);
+        case ftASin:
+            return asin(target);
+        case ftACos:
+            return acos(target);
+        case ftATan:
+            return atan(target);
+        case ftSinH:
+            return sinh(target);
+        case ftCosH:
+            return cosh(target);
+        case ftTanH:
+            return tanh(target);
+        case ftASinH:
+            return asinh(target);
+        case ftACosH:
+            return acosh(target);
+        case ftATanH:
+            return atanh(target);
+        case ftLog:
+            return log(target);
+        case ftLog10:
+            return log10(target);
+        case ftLog2:
+            return log2(target);
+        case ftSqr:
+            return target * target;
+        case ftSqrt:
+            return sqrt(target);
+        case ftAbs:
+            return abs(target);
+        case ftSign:
+            return int(target > 0) - int(target < 0);
+        case ftDeg:
+            return target * (180 / calcPi <T> ());
+        case ftRad:
+            return target * (calcPi <T> () / 180);
+        case ftErf:
+            return erf(target);
+        case ftErfc:
+            return erfc(target);
+        case ftGamma:
+            return tgamma(target);
+        case ftLGamma:
+            return lgamma(target);
+        case ftCeil:
+            return ceil(target);
+        case ftFloor:
+            return floor(target);
+        case ftTrunc:
+            return trunc(target);
+        case ftRound:
+            return round(target);
+        case ftInt:
+            return trunc(target);
+        }
+
+        // Never reach
+        return NAN;
+    }
+
+    template map <Input, float> &getConsts <float> ();
+    template map <Input, long double> &getConsts <long double> ();
+
+    template float calcBi <float> (const BiOperType, const float, const float);
+    template double calcBi <double> (const BiOperType, const double, const double);
+    template long double calcBi <long double> (const BiOperType, const long double, const long double);
+
+    template float calcMono <float> (const MonoOperType, const float);
+    template double calcMono <double> (const MonoOperType, const double);
+    template long double calcMono <long double> (const MonoOperType, const long double);
+
+    template float calcFunc <float> (const FuncType, const float);
+    template double calcFunc <double> (const FuncType, const double);
+    template long double calcFunc <long double> (const FuncType, const long double);
+
+#if defined(CALC_FLOAT128)
+    template map <Input, CalcQuad> &getConsts <CalcQuad> ();
+    template CalcQuad calcBi <CalcQuad> (const BiOperType, const CalcQuad, const CalcQuad);
+    template CalcQuad calcMono <CalcQuad> (const MonoOperType, const CalcQuad);
+    template CalcQuad calcFunc <CalcQuad> (const FuncType, const CalcQuad);
+#endif
 }
@@ -1,18 +1,37 @@
 #ifndef __INC_CALCRULE_HPP__
 #define __INC_CALCRULE_HPP__
 
-#define _USE_MATH_DEFINES
-#include <cmath>
+#include <cstdint>
 #include "opparser.hpp"
+#include "opcalcmath.hpp"
 
 namespace OPParser {
     // Type of data in the calculator
+    // Calculators and programs are templates of value types, see opcalcmath.hpp
+    // float, double, long double and __float128 (if CALC_FLOAT128) are instantiated
+    // This is the default one
     typedef double CalcData;
 
+    // Type of exact integers in the calculator
+    // Integer results stay exact until overflow or a non-integer operation
+    typedef int64_t CalcInt;
+
     // Precedence levels, from 0 to 4095
     const Level levelConst = 4095;
     const Level levelAcceptAll = 0;
     const Level levelFlushAll = 1;
+    const Level levelCondR = 16;
+    const Level levelElseL = 17;
+    const Level levelElseR = 30;
+    const Level levelCondL = 31;
+    const Level levelOrL = 63;
+    const Level levelOrR = 64;
+    const Level levelAndL = 95;
+    const Level levelAndR = 96;
+    const Level levelEqualL = 127;
+    const Level levelEqualR = 128;
+    const Level levelLessL = 191;
+    const Level levelLessR = 192;
     const Level levelAddSubL = 255;
     const Level levelAddSubR = 256;
     const Level levelMulDivL = 511;
@@ -30,7 +49,9 @@ namespace OPParser {
     const State stateAssign = stateInitial + 2;
 
     // Bi-operators
-    enum BiOperType {otAdd, otSub, otMul, otIMul, otDiv, otMod, otPwr};
+    // Comparisons and logical operators give 1 or 0, values other than 0 (NaN too) are true
+    enum BiOperType {otAdd, otSub, otMul, otIMul, otDiv, otMod, otPwr,
+                     otLess, otLessEq, otGreater, otGreaterEq, otEqual, otNotEqual, otAnd, otOr};
 
     // Mono-operators
     enum MonoOperType {mtPos, mtNeg, mtFac};
@@ -42,11 +63,26 @@ namespace OPParser {
                    ftDeg, ftRad, ftErf, ftErfc, ftGamma, ftLGamma,
                    ftCeil, ftFloor, ftTrunc, ftRound, ftInt};
 
-    // Function name-type map
-    extern map <Input, FuncType> GetFunc;
+    // Functions of expressions, like integrate(expr, x, a, b) and sum(i, a, b, expr)
+    enum CallType {ctIntegrate, ctSolve, ctSum, ctProd};
+
+    // Function name-type map, never changed
+    extern const map <Input, FuncType> GetFunc;
+
+    // Function of expressions name-type map, never changed
+    extern const map <Input, CallType> GetCall;
 
     // Const name-value map
     extern map <Input, CalcData> GetConst;
+
+    // Const name-value map of a value type, GetConst for CalcData
+    template <class T> map <Input, T> &getConsts();
+    template <> map <Input, CalcData> &getConsts <CalcData> ();
+
+    // Calculate operators and functions
+    template <class T> T calcBi(const BiOperType type, const T left, const T right);
+    template <class T> T calcMono(const MonoOperType type, const T target);
+    template <class T> T calcFunc(const FuncType type, const T target);
 }
 
 #endif
@@ -0,0 +1,132 @@
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+#include "opcalcscan.hpp"
+
+namespace OPParser {
+    int charClass(const char c) {
+        if (c >= '0' && c <= '9') {
+            return ccDigit;
+        }
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_') {
+            return ccAlpha;
+        }
+
+        switch (c) {
+        case 0:
+        case '\t':
+        case '\n':
+        case '\r':
+        case ' ':
+            return ccBlank;
+        case '.':
+            return ccDot;
+        default:
+            return 0;
+        }
+    }
+
+#if defined(__SSE2__)
+    // Set bytes to 0xFF if in the classes
+    __m128i charClass16(const __m128i data, const int classes) {
+        __m128i result = _mm_setzero_si128();
+
+        if (classes & ccDigit) {
+            // Unsigned (c - '0') <= 9
+            const __m128i offset = _mm_sub_epi8(data, _mm_set1_epi8('0'));
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset));
+        }
+        if (classes & ccAlpha) {
+            // Unsigned ((c | 0x20) - 'a') <= 25
+            const __m128i offset = _mm_sub_epi8(_mm_or_si128(data, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(25)), offset));
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(data, _mm_set1_epi8('_')));
+        }
+        if (classes & ccBlank) {
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(data, _mm_setzero_si128()));
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(data, _mm_set1_epi8('\t')));
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(data, _mm_set1_epi8('\n')));
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(data, _mm_set1_epi8('\r')));
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(data, _mm_set1_epi8(' ')));
+        }
+        if (classes & ccDot) {
+            result = _mm_or_si128(result, _mm_cmpeq_epi8(data, _mm_set1_epi8('.')));
+        }
+
+        return result;
+    }
+#endif
+
+#if defined(__AVX2__)
+    // Set bytes to 0xFF if in the classes
+    __m256i charClass32(const __m256i data, const int classes) {
+        __m256i result = _mm256_setzero_si256();
+
+        if (classes & ccDigit) {
+            const __m256i offset = _mm256_sub_epi8(data, _mm256_set1_epi8('0'));
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(9)), offset));
+        }
+        if (classes & ccAlpha) {
+            const __m256i offset = _mm256_sub_epi8(_mm256_or_si256(data, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(25)), offset));
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(data, _mm256_set1_epi8('_')));
+        }
+        if (classes & ccBlank) {
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(data, _mm256_setzero_si256()));
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\t')));
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\n')));
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\r')));
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(data, _mm256_set1_epi8(' ')));
+        }
+        if (classes & ccDot) {
+            result = _mm256_or_si256(result, _mm256_cmpeq_epi8(data, _mm256_set1_epi8('.')));
+        }
+
+        return result;
+    }
+#endif
+
+    InputIter scanRun(const InputIter &now, const InputIter &end, const int classes) {
+        const size_t size = end - now;
+        if (size == 0) {
+            return now;
+        }
+
+        const char *data = &*now;
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        for (; i + 32 <= size; i += 32) {
+            const __m256i chars = _mm256_loadu_si256((const __m256i *) (data + i));
+            const unsigned mask = ~unsigned(_mm256_movemask_epi8(charClass32(chars, classes)));
+
+            if (mask) {
+                return now + (i + __builtin_ctz(mask));
+            }
+        }
+#endif
+
+#if defined(__SSE2__)
+        for (; i + 16 <= size; i += 16) {
+            const __m128i chars = _mm_loadu_si128((const __m128i *) (data + i));
+            const unsigned mask = ~unsigned(_mm_movemask_epi8(charClass16(chars, classes))) & 0xFFFF;
+
+            if (mask) {
+                return now + (i + __builtin_ctz(mask));
+            }
+        }
+#endif
+
+        // Scalar fallback, and the tail
+        for (; i < size; ++i) {
+            if (!(charClass(data[i]) & classes)) {
+                break;
+            }
+        }
+
+        return now + i;
+    }
+}
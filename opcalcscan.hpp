@@ -0,0 +1,23 @@
+#ifndef __INC_CALCSCAN_HPP__
+#define __INC_CALCSCAN_HPP__
+
+#include "opparser.hpp"
+
+namespace OPParser {
+    // Character classes, can be combined
+    enum CharClass {
+        ccDigit = 1, // 0-9
+        ccAlpha = 2, // A-Z, a-z and _
+        ccBlank = 4, // \0, \t, \n, \r and space
+        ccDot = 8    // .
+    };
+
+    // Get the classes of a character
+    int charClass(const char c);
+
+    // Find the end of a run of characters in the classes
+    // Scan 16 (SSE2) or 32 (AVX2) characters at a time if possible
+    InputIter scanRun(const InputIter &now, const InputIter &end, const int classes);
+}
+
+#endif
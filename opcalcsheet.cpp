@@ -0,0 +1,224 @@
+#include <queue>
+#include <algorithm>
+#include "opcalcsheet.hpp"
+#include "opcalcscan.hpp"
+
+namespace OPParser {
+    bool CalcSheet::reads(const Input &target, const Input &name) {
+        if (target == name) {
+            return 1;
+        }
+
+        const auto foundTarget = cells.find(target);
+        if (foundTarget == cells.end()) {
+            return 0;
+        }
+        const size_t rank = foundTarget->second.rank;
+
+        // Search from name to its users
+        // Users always have greater ranks, so stop at the rank of target
+        set <Input> visited = {name};
+        vector <Input> todo = {name};
+
+        while (!todo.empty()) {
+            const Input now = todo.back();
+            todo.pop_back();
+
+            const auto found = cells.find(now);
+            if (found == cells.end()) {
+                continue;
+            }
+
+            for (const Input &user: found->second.users) {
+                if (user == target) {
+                    return 1;
+                }
+                if (cells[user].rank < rank && visited.insert(user).second) {
+                    todo.push_back(user);
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    void CalcSheet::raise(const Input &name) {
+        const size_t rank = cells[name].rank;
+
+        for (const Input &user: cells[name].users) {
+            Cell &cell = cells[user];
+
+            if (cell.rank <= rank) {
+                cell.rank = rank + 1;
+                raise(user);
+            }
+        }
+    }
+
+    CalcData CalcSheet::calc(const Cell &cell, const Calc &calc) const {
+        vector <CalcData> params;
+
+        for (const Input &param: cell.params) {
+            const CalcData *found = calc.findConst(param);
+            params.push_back(found != nullptr ? *found : NAN);
+        }
+
+        return cell.program->run(params);
+    }
+
+    void CalcSheet::recompute(const Input &name, Calc &calc) {
+        typedef pair <size_t, Input> Item;
+
+        // Min-heap by rank
+        priority_queue <Item, vector <Item>, greater <Item> > dirty;
+        set <Input> queued;
+
+        for (const Input &user: cells[name].users) {
+            dirty.push({cells[user].rank, user});
+            queued.insert(user);
+        }
+
+        while (!dirty.empty()) {
+            const Input target = dirty.top().second;
+            dirty.pop();
+            queued.erase(target);
+
+            const Cell &cell = cells[target];
+            const CalcData value = this->calc(cell, calc);
+            const CalcData *found = calc.findConst(target);
+            const CalcData old = found != nullptr ? *found : 0;
+
+            // Unchanged (NaN is unchanged too)
+            if (value == old || (value != value && old != old)) {
+                continue;
+            }
+            (*calc.consts)[target] = value;
+
+            for (const Input &user: cell.users) {
+                if (queued.insert(user).second) {
+                    dirty.push({cells[user].rank, user});
+                }
+            }
+        }
+    }
+
+    bool CalcSheet::define(const Input &name, const Input &input, Calc &calc) {
+        // Names read, except ans (ans changes every time)
+        vector <Input> params;
+        for (InputIter now = input.begin(); now != input.end();) {
+            if (charClass(*now) & ccAlpha) {
+                const InputIter begin = now;
+                now = scanRun(now, input.end(), ccAlpha | ccDigit);
+                const Input param(begin, now);
+
+                if (param != "ans" && calc.findConst(param) != nullptr
+                    && find(params.begin(), params.end(), param) == params.end()) {
+                    params.push_back(param);
+                }
+            } else {
+                ++now;
+            }
+        }
+
+        for (const Input &param: params) {
+            if (reads(param, name)) {
+                return 0;
+            }
+        }
+
+        PCalcProgram program = calc.compile(input, params);
+
+        // Update the graph
+        Cell &cell = cells[name];
+        for (const Input &param: cell.params) {
+            cells[param].users.erase(name);
+        }
+
+        cell.program = program;
+        cell.params = params;
+        for (const Input &param: params) {
+            Cell &paramCell = cells[param];
+
+            paramCell.users.insert(name);
+            if (cell.rank <= paramCell.rank) {
+                cell.rank = paramCell.rank + 1;
+            }
+        }
+        raise(name);
+
+        (*calc.consts)[name] = this->calc(cell, calc);
+        recompute(name, calc);
+
+        return 1;
+    }
+
+    void CalcSheet::assign(const Input &name, Calc &calc) {
+        Cell &cell = cells[name];
+
+        // Not defined by an expression any more
+        for (const Input &param: cell.params) {
+            cells[param].users.erase(name);
+        }
+        cell.program = nullptr;
+        cell.params.clear();
+
+        recompute(name, calc);
+    }
+
+    void CalcSheet::save(SnapWriter &writer) const {
+        writer.putInt(cells.size());
+
+        for (const auto &item: cells) {
+            const Cell &cell = item.second;
+
+            writer.putString(item.first);
+            writer.putInt(cell.rank);
+
+            writer.putInt(cell.params.size());
+            for (const Input &param: cell.params) {
+                writer.putString(param);
+            }
+
+            writer.putInt(bool(cell.program));
+            if (cell.program) {
+                cell.program->save(writer);
+            }
+        }
+    }
+
+    void CalcSheet::load(SnapReader &reader) {
+        map <Input, Cell> result;
+
+        const size_t cellNum = reader.getCount(4);
+        for (size_t i = 0; i < cellNum; ++i) {
+            const Input name = reader.getString();
+            Cell &cell = result[name];
+
+            cell.rank = reader.getInt();
+
+            const size_t paramNum = reader.getCount(1);
+            for (size_t j = 0; j < paramNum; ++j) {
+                cell.params.push_back(reader.getString());
+            }
+
+            if (reader.getInt()) {
+                cell.program = CalcProgram::load(reader);
+                check(cell.program->getParamNum() == cell.params.size(), "Bad snapshot");
+            } else {
+                check(cell.params.empty(), "Bad snapshot");
+            }
+        }
+
+        // Users, and check ranks (no circle)
+        for (auto &item: result) {
+            for (const Input &param: item.second.params) {
+                Cell &paramCell = result[param];
+
+                check(paramCell.rank < item.second.rank, "Bad snapshot");
+                paramCell.users.insert(item.first);
+            }
+        }
+
+        cells.swap(result);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef __INC_CALCSHEET_HPP__
+#define __INC_CALCSHEET_HPP__
+
+#include <set>
+#include "opcalc.hpp"
+
+namespace OPParser {
+    // Dependency graph of names, like a spreadsheet
+    // A defined name keeps its expression and is recomputed when names it reads change
+    class CalcSheet {
+    protected:
+        struct Cell {
+            // Expression and the names it reads, nullptr if assigned by value
+            PCalcProgram program = nullptr;
+            vector <Input> params = {};
+
+            // Names reading this name
+            set <Input> users = {};
+
+            // Topological rank, greater than the ranks of params
+            size_t rank = 0;
+        };
+
+        map <Input, Cell> cells = {};
+
+        // Check if target reads name (directly or not)
+        // Search only names ranked below target
+        bool reads(const Input &target, const Input &name);
+
+        // Raise ranks of users after the rank of name is raised
+        void raise(const Input &name);
+
+        // Calculate a defined name
+        CalcData calc(const Cell &cell, const Calc &calc) const;
+
+        // Recompute users of name in topological order
+        // Users are recomputed only if a name they read changed
+        void recompute(const Input &name, Calc &calc);
+    public:
+        // Define name by an expression, and recompute users
+        // Return false if the definition is circular (nothing done)
+        bool define(const Input &name, const Input &input, Calc &calc);
+
+        // Name is assigned by value, recompute users
+        void assign(const Input &name, Calc &calc);
+
+        // Write to a snapshot
+        void save(SnapWriter &writer) const;
+
+        // Read from a snapshot, replacing all names
+        void load(SnapReader &reader);
+    };
+}
+
+#endif
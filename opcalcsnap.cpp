@@ -0,0 +1,254 @@
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+#include "opcalcsnap.hpp"
+
+namespace OPParser {
+    // "OPCALC" and version 2
+    const uint64_t snapMagic = 0x0002434c4143504full;
+
+    SnapWriter::SnapWriter() {
+        putInt(snapMagic);
+    }
+
+    void SnapWriter::putInt(const uint64_t value) {
+        words.push_back(value);
+    }
+
+    void SnapWriter::putData(const CalcData value) {
+        uint64_t word;
+        memcpy(&word, &value, sizeof(word));
+        words.push_back(word);
+    }
+
+    void SnapWriter::putString(const Input &value) {
+        const size_t size = words.size();
+
+        putInt(value.size());
+        words.resize(size + 1 + (value.size() + 7) / 8, 0);
+        memcpy(words.data() + size + 1, value.data(), value.size());
+    }
+
+    void SnapWriter::putTable(const map <Input, CalcData> &values) {
+        putInt(values.size());
+
+        // Offsets and the number of words of entries are set after writing them
+        const size_t head = words.size();
+        words.resize(head + 1 + values.size(), 0);
+
+        const size_t begin = words.size();
+        size_t index = 0;
+        for (const auto &item: values) {
+            words[head + 1 + index++] = words.size() - begin;
+            putString(item.first);
+            putData(item.second);
+        }
+
+        words[head] = words.size() - begin;
+    }
+
+    void SnapWriter::save(const Input &path) const {
+        const Input temp = path + ".tmp";
+
+        bool written;
+        {
+            ofstream file(temp, ios::binary | ios::trunc);
+            file.write((const char *) words.data(), words.size() * sizeof(uint64_t));
+            file.close();
+            written = bool(file);
+        }
+
+        if (!written || rename(temp.c_str(), path.c_str()) != 0) {
+            remove(temp.c_str());
+            error("Can not write snapshot");
+        }
+    }
+
+    SnapReader::SnapReader(const Input &path) {
+#if defined(__unix__) || defined(__APPLE__)
+        const int file = open(path.c_str(), O_RDONLY);
+        check(file >= 0, "Can not read snapshot");
+
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0) {
+            mappedSize = info.st_size;
+            mapped = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapped == MAP_FAILED) {
+                mapped = nullptr;
+            }
+        }
+        close(file);
+
+        check(mapped != nullptr, "Can not read snapshot");
+
+        now = (const uint64_t *) mapped;
+        end = now + mappedSize / sizeof(uint64_t);
+#else
+        ifstream file(path, ios::binary | ios::ate);
+        check(bool(file), "Can not read snapshot");
+
+        buffer.resize(size_t(file.tellg()) / sizeof(uint64_t));
+        file.seekg(0);
+        file.read((char *) buffer.data(), buffer.size() * sizeof(uint64_t));
+        check(bool(file), "Can not read snapshot");
+
+        now = buffer.data();
+        end = now + buffer.size();
+#endif
+
+        check(now != end && *now++ == snapMagic, "Bad snapshot");
+    }
+
+    SnapReader::~SnapReader() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped) {
+            munmap(mapped, mappedSize);
+        }
+#endif
+    }
+
+    uint64_t SnapReader::getInt() {
+        check(now != end, "Bad snapshot");
+
+        return *now++;
+    }
+
+    CalcData SnapReader::getData() {
+        const uint64_t word = getInt();
+
+        CalcData result;
+        memcpy(&result, &word, sizeof(result));
+        return result;
+    }
+
+    Input SnapReader::getString() {
+        const uint64_t size = getInt();
+        check(size <= uint64_t(end - now) * 8, "Bad snapshot");
+
+        const Input result((const char *) now, size);
+        now += (size + 7) / 8;
+        return result;
+    }
+
+    size_t SnapReader::getCount(const size_t minWords) {
+        const uint64_t count = getInt();
+        check(count <= uint64_t(end - now) / minWords, "Bad snapshot");
+
+        return count;
+    }
+
+    SnapTable SnapReader::getTable() {
+        SnapTable result;
+
+        // An offset, a name size and a value at least
+        result.count = getCount(3);
+
+        const uint64_t wordNum = getInt();
+        check(result.count <= uint64_t(end - now) && wordNum <= uint64_t(end - now) - result.count, "Bad snapshot");
+
+        result.offsets = now;
+        result.begin = now + result.count;
+        result.end = result.begin + wordNum;
+
+        now = result.end;
+        return result;
+    }
+
+    const uint64_t *SnapTable::getEntry(const size_t index, const char *&name, size_t &size) const {
+        const uint64_t offset = offsets[index];
+        check(offset < uint64_t(end - begin), "Bad snapshot");
+
+        const uint64_t *now = begin + offset;
+        const uint64_t nameSize = *now++;
+
+        // Words of the name and the value
+        check(now != end && nameSize <= uint64_t(end - now - 1) * 8, "Bad snapshot");
+
+        name = (const char *) now;
+        size = nameSize;
+        return now + (nameSize + 7) / 8;
+    }
+
+    const CalcData *SnapTable::find(const Input &name) const {
+        size_t low = 0;
+        size_t high = count;
+
+        while (low < high) {
+            const size_t middle = low + (high - low) / 2;
+
+            const char *key;
+            size_t size;
+            const uint64_t *value = getEntry(middle, key, size);
+
+            const int order = name.compare(0, Input::npos, key, size);
+            if (order == 0) {
+                // Words are 8-byte aligned, as CalcData
+                return (const CalcData *) value;
+            } else if (order < 0) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void SnapTable::list(map <Input, CalcData> &target) const {
+        for (size_t i = 0; i < count; ++i) {
+            const char *key;
+            size_t size;
+            const uint64_t *value = getEntry(i, key, size);
+
+            CalcData data;
+            memcpy(&data, value, sizeof(data));
+            target[Input(key, size)] = data;
+        }
+    }
+
+    void saveTokens(const TokenBuffer &tokens, SnapWriter &writer) {
+        writer.putInt(tokens.inputSize);
+        writer.putInt(tokens.status.kind);
+        writer.putInt(tokens.status.offset);
+
+        writer.putInt(tokens.kinds.size());
+        for (size_t i = 0; i < tokens.kinds.size(); ++i) {
+            writer.putInt(tokens.kinds[i]);
+            writer.putInt(tokens.payloads[i]);
+            writer.putInt(tokens.offsets[i]);
+        }
+
+        writer.putInt(tokens.texts.size());
+        for (const Input &text: tokens.texts) {
+            writer.putString(text);
+        }
+    }
+
+    TokenBuffer loadTokens(SnapReader &reader) {
+        TokenBuffer result;
+
+        result.inputSize = reader.getInt();
+        result.status.kind = int(reader.getInt());
+        result.status.offset = reader.getInt();
+
+        const size_t tokenNum = reader.getCount(3);
+        for (size_t i = 0; i < tokenNum; ++i) {
+            result.kinds.push_back(int(reader.getInt()));
+            result.payloads.push_back(reader.getInt());
+            result.offsets.push_back(reader.getInt());
+        }
+
+        const size_t textNum = reader.getCount(1);
+        for (size_t i = 0; i < textNum; ++i) {
+            result.texts.push_back(reader.getString());
+        }
+
+        return result;
+    }
+}
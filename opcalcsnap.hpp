@@ -0,0 +1,102 @@
+#ifndef __INC_CALCSNAP_HPP__
+#define __INC_CALCSNAP_HPP__
+
+#include "opcalcrule.hpp"
+
+namespace OPParser {
+    // Binary snapshots of sessions
+    // Data are 8-byte words in native byte order
+    // Strings are a length and words of characters
+    // Nothing is parsed when loading, so a snapshot is only for the same build
+
+    // Build a snapshot in memory, then save it
+    class SnapWriter {
+    protected:
+        vector <uint64_t> words = {};
+    public:
+        // Start with the magic word
+        SnapWriter();
+
+        void putInt(const uint64_t value);
+        void putData(const CalcData value);
+        void putString(const Input &value);
+
+        // Write names and values, to be found without reading all (see SnapTable)
+        void putTable(const map <Input, CalcData> &values);
+
+        // Save to a file
+        // Write a temporary file and rename it, so the old snapshot stays if failed
+        void save(const Input &path) const;
+    };
+
+    class SnapTable;
+
+    // Read a snapshot from a file, mapped to memory if possible
+    // Throw errors if the snapshot is broken
+    class SnapReader {
+    protected:
+        const uint64_t *now = nullptr;
+        const uint64_t *end = nullptr;
+
+        // Mapped memory
+        void *mapped = nullptr;
+        size_t mappedSize = 0;
+
+        // Data read, if not mapped
+        vector <uint64_t> buffer = {};
+    public:
+        // Open and check the magic word
+        SnapReader(const Input &path);
+        ~SnapReader();
+
+        SnapReader(const SnapReader &) = delete;
+        SnapReader &operator=(const SnapReader &) = delete;
+
+        uint64_t getInt();
+        CalcData getData();
+        Input getString();
+
+        // Get a count of items, each has at least minWords words
+        size_t getCount(const size_t minWords);
+
+        // Get a table written by SnapWriter::putTable, without reading its entries
+        SnapTable getTable();
+    };
+
+    // Names and values in a snapshot, sorted by name
+    // Entries are read (and checked) from the snapshot only when found, so it is O(log n)
+    // Valid while its reader is
+    class SnapTable {
+    protected:
+        // Offsets of entries from begin, in order of names
+        const uint64_t *offsets = nullptr;
+        size_t count = 0;
+
+        // Entries, each a name and a value
+        const uint64_t *begin = nullptr;
+        const uint64_t *end = nullptr;
+
+        // Read the index-th name, return the value after it
+        const uint64_t *getEntry(const size_t index, const char *&name, size_t &size) const;
+    public:
+        friend class SnapReader;
+
+        size_t size() const {
+            return count;
+        }
+
+        // Find a value in the snapshot, nullptr if not found
+        const CalcData *find(const Input &name) const;
+
+        // Read all names and values to target
+        void list(map <Input, CalcData> &target) const;
+    };
+
+    // Write a token buffer (see Parser::tryLex)
+    void saveTokens(const TokenBuffer &tokens, SnapWriter &writer);
+
+    // Read a token buffer, tokens are checked when parsed by Parser::tryReplay
+    TokenBuffer loadTokens(SnapReader &reader);
+}
+
+#endif
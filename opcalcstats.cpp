@@ -0,0 +1,165 @@
+#include <cmath>
+#include <algorithm>
+#include "opcalcstats.hpp"
+
+namespace OPParser {
+    LatencyHistogram::LatencyHistogram() {
+        clear();
+    }
+
+    size_t LatencyHistogram::bucketOf(const uint64_t value) {
+        if (value < subNum) {
+            return value;
+        }
+
+        // Top 5 bits, 1xxxx
+        const size_t bits = 63 - __builtin_clzll(value);
+        return (bits - 3) * subNum + (value >> (bits - 4)) - subNum;
+    }
+
+    uint64_t LatencyHistogram::valueOf(const size_t bucket) {
+        if (bucket < subNum) {
+            return bucket;
+        }
+
+        const size_t shift = bucket / subNum - 1;
+        const uint64_t low = uint64_t(subNum + bucket % subNum) << shift;
+        return low + ((uint64_t(1) << shift) - 1);
+    }
+
+    void LatencyHistogram::record(const uint64_t value) {
+        counts[bucketOf(value)].fetch_add(1, memory_order_relaxed);
+        sum.fetch_add(value, memory_order_relaxed);
+
+        uint64_t now = max.load(memory_order_relaxed);
+        while (value > now && !max.compare_exchange_weak(now, value, memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t LatencyHistogram::getCount() const {
+        uint64_t result = 0;
+        for (size_t i = 0; i < bucketNum; ++i) {
+            result += counts[i].load(memory_order_relaxed);
+        }
+        return result;
+    }
+
+    uint64_t LatencyHistogram::getSum() const {
+        return sum.load(memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::getMax() const {
+        return max.load(memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::quantile(const double q) const {
+        // Copy first, as counts may change
+        vector <uint64_t> now(bucketNum);
+        uint64_t count = 0;
+        for (size_t i = 0; i < bucketNum; ++i) {
+            now[i] = counts[i].load(memory_order_relaxed);
+            count += now[i];
+        }
+        if (count == 0) {
+            return 0;
+        }
+
+        // Rank of the value, from 1
+        const uint64_t rank = std::max(uint64_t(1), std::min(count, uint64_t(ceil(q * count))));
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucketNum; ++i) {
+            seen += now[i];
+            if (seen >= rank) {
+                return std::min(valueOf(i), getMax());
+            }
+        }
+        return getMax();
+    }
+
+    void LatencyHistogram::clear() {
+        for (size_t i = 0; i < bucketNum; ++i) {
+            counts[i].store(0, memory_order_relaxed);
+        }
+        sum.store(0, memory_order_relaxed);
+        max.store(0, memory_order_relaxed);
+    }
+
+    // Faster first, for the min-heap
+    static bool slower(const SlowExpr &left, const SlowExpr &right) {
+        return left.total > right.total;
+    }
+
+    CalcStats::CalcStats(const size_t slowNum): slowNum(slowNum), threshold(0) {}
+
+    void CalcStats::record(const Input &text, const uint64_t total, const ParseTimes &times) {
+        totalTimes.record(total);
+        lexTimes.record(times.lex);
+        stackTimes.record(times.stack);
+        mathTimes.record(times.math);
+
+        // Most expressions are not the slowest, skip the lock
+        if (slowNum == 0 || total <= threshold.load(memory_order_relaxed)) {
+            return;
+        }
+
+        lock_guard <mutex> guard(lock);
+
+        if (slowest.size() == slowNum) {
+            if (total <= slowest.front().total) {
+                return;
+            }
+            pop_heap(slowest.begin(), slowest.end(), slower);
+            slowest.pop_back();
+        }
+
+        slowest.push_back({text, total, times});
+        push_heap(slowest.begin(), slowest.end(), slower);
+
+        if (slowest.size() == slowNum) {
+            threshold.store(slowest.front().total, memory_order_relaxed);
+        }
+    }
+
+    vector <SlowExpr> CalcStats::getSlowest() const {
+        vector <SlowExpr> result;
+        {
+            lock_guard <mutex> guard(lock);
+            result = slowest;
+        }
+
+        sort(result.begin(), result.end(), slower);
+        return result;
+    }
+
+    void CalcStats::clear() {
+        totalTimes.clear();
+        lexTimes.clear();
+        stackTimes.clear();
+        mathTimes.clear();
+
+        lock_guard <mutex> guard(lock);
+        slowest.clear();
+        threshold.store(0, memory_order_relaxed);
+    }
+
+    void CalcStats::dump(ostream &out) const {
+        const pair <const char *, const LatencyHistogram *> stages[] = {
+            {"total", &totalTimes}, {"lex", &lexTimes}, {"stack", &stackTimes}, {"math", &mathTimes}
+        };
+
+        for (const auto &stage: stages) {
+            const LatencyHistogram &times = *stage.second;
+            const uint64_t count = times.getCount();
+
+            out<<stage.first<<" count "<<count<<" mean "<<(count ? times.getSum() / count : 0)
+               <<" p50 "<<times.quantile(0.5)<<" p90 "<<times.quantile(0.9)<<" p99 "<<times.quantile(0.99)
+               <<" p999 "<<times.quantile(0.999)<<" max "<<times.getMax()<<endl;
+        }
+
+        for (const SlowExpr &expr: getSlowest()) {
+            out<<"slow "<<expr.total<<" "<<expr.times.lex<<" "<<expr.times.stack<<" "<<expr.times.math
+               <<" "<<expr.text<<endl;
+        }
+    }
+}
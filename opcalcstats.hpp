@@ -0,0 +1,82 @@
+#ifndef __INC_CALCSTATS_HPP__
+#define __INC_CALCSTATS_HPP__
+
+#include <iostream>
+#include <mutex>
+#include "opparser.hpp"
+
+namespace OPParser {
+    // Histogram of nanoseconds, log-linear like HDR histograms
+    // Values are kept within 1/16, up to 2^64
+    // Lock-free, so threads can record at the same time
+    class LatencyHistogram {
+    protected:
+        // Buckets for each power of 2
+        static const size_t subNum = 16;
+        static const size_t bucketNum = 61 * subNum;
+
+        atomic <uint64_t> counts[bucketNum];
+        atomic <uint64_t> sum;
+        atomic <uint64_t> max;
+
+        static size_t bucketOf(const uint64_t value);
+
+        // The greatest value of a bucket
+        static uint64_t valueOf(const size_t bucket);
+    public:
+        LatencyHistogram();
+
+        void record(const uint64_t value);
+
+        uint64_t getCount() const;
+        uint64_t getSum() const;
+        uint64_t getMax() const;
+
+        // Value at quantile q (from 0 to 1), 0 if empty
+        uint64_t quantile(const double q) const;
+
+        // Not atomic as a whole, records at the same time may be kept or not
+        void clear();
+    };
+
+    // An expression and its time, in nanoseconds
+    struct SlowExpr {
+        Input text;
+        uint64_t total;
+        ParseTimes times;
+    };
+
+    // Latency of expressions
+    // Histograms of the total and of each stage, and a log of the slowest expressions
+    class CalcStats {
+    protected:
+        size_t slowNum;
+
+        // Min-heap by total, at most slowNum
+        vector <SlowExpr> slowest = {};
+        mutable mutex lock;
+
+        // Total of the fastest kept when full, to skip the lock
+        atomic <uint64_t> threshold;
+    public:
+        LatencyHistogram totalTimes, lexTimes, stackTimes, mathTimes;
+
+        // Keep the slowest slowNum expressions
+        explicit CalcStats(const size_t slowNum = 16);
+
+        // Record an expression, can be called by threads at the same time
+        void record(const Input &text, const uint64_t total, const ParseTimes &times);
+
+        // The slowest expressions, slowest first
+        vector <SlowExpr> getSlowest() const;
+
+        void clear();
+
+        // Write as lines of text, to be read by scripts
+        // "<stage> count <n> mean <ns> p50 <ns> p90 <ns> p99 <ns> p999 <ns> max <ns>", for total, lex, stack and math
+        // "slow <total> <lex> <stack> <math> <text>", slowest first
+        void dump(ostream &out) const;
+    };
+}
+
+#endif
@@ -0,0 +1,477 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "opcalc.hpp"
+#include "opcalcscan.hpp"
+
+// Run formulas over columns, as a stream filter
+// Usage: ./calcstream [-b x,y,...] [-B] [-f] [-n rows] 'expr -> name' ... < input > output
+//     Input is CSV with a header of column names, or with -b, rows of little-endian doubles
+//     Output is CSV of the named results, or with -B, rows of little-endian doubles
+//     -f uses fast functions (see calcFuncs), -n sets rows per chunk
+
+namespace OPParser {
+    // Rows of input, a chunk at a time
+    // Empty chunk for the end of input
+    struct StreamChunk {
+        vector <vector <CalcData> > columns = {};
+        size_t rows = 0;
+    };
+
+    typedef shared_ptr <StreamChunk> PStreamChunk;
+
+    // Chunks passed between threads
+    class ChunkQueue {
+    protected:
+        vector <PStreamChunk> chunks = {};
+        mutex lock;
+        condition_variable ready;
+    public:
+        void push(const PStreamChunk chunk) {
+            {
+                lock_guard <mutex> guard(lock);
+                chunks.push_back(chunk);
+            }
+            ready.notify_one();
+        }
+
+        PStreamChunk pop() {
+            unique_lock <mutex> guard(lock);
+            ready.wait(guard, [this]() {
+                return !chunks.empty();
+            });
+
+            const PStreamChunk result = chunks.front();
+            chunks.erase(chunks.begin());
+            return result;
+        }
+    };
+
+    // Read a file in large blocks
+    class BlockInput {
+    protected:
+        FILE *file;
+        vector <char> data;
+
+        // Data not read yet, data[end] is always 0 (for strtod)
+        size_t begin = 0;
+        size_t end = 0;
+
+        bool eof = 0;
+
+        // Move the rest to the front and read more
+        // Return false if nothing more
+        bool fill() {
+            if (eof) {
+                return 0;
+            }
+
+            memmove(data.data(), data.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+
+            // Grow for long lines
+            if (end + 1 == data.size()) {
+                data.resize(data.size() * 2);
+            }
+
+            const size_t size = fread(data.data() + end, 1, data.size() - 1 - end, file);
+            if (size == 0) {
+                eof = 1;
+            }
+            end += size;
+            data[end] = 0;
+
+            return size != 0;
+        }
+    public:
+        BlockInput(FILE *toFile, const size_t blockSize): file(toFile), data(blockSize + 1, 0) {}
+
+        // Get a line without '\n', valid until the next call
+        // Return false at the end
+        bool getLine(const char *&lineBegin, const char *&lineEnd) {
+            size_t searched = begin;
+
+            while (1) {
+                const char *found = (const char *) memchr(data.data() + searched, '\n', end - searched);
+                if (found != nullptr) {
+                    lineBegin = data.data() + begin;
+                    lineEnd = found;
+                    begin = found - data.data() + 1;
+                    return 1;
+                }
+
+                searched = end - begin;
+                if (!fill()) {
+                    break;
+                }
+            }
+
+            // The last line without '\n'
+            if (begin == end) {
+                return 0;
+            }
+            lineBegin = data.data() + begin;
+            lineEnd = data.data() + end;
+            begin = end;
+            return 1;
+        }
+
+        // Read n bytes, return the bytes read
+        size_t read(char *target, const size_t n) {
+            size_t done = 0;
+
+            while (done < n) {
+                if (begin == end && !fill()) {
+                    break;
+                }
+
+                const size_t size = min(n - done, end - begin);
+                memcpy(target + done, data.data() + begin, size);
+                begin += size;
+                done += size;
+            }
+
+            return done;
+        }
+    };
+
+    // Split a CSV header, names are trimmed
+    vector <Input> splitHeader(const char *begin, const char *end) {
+        vector <Input> result(1);
+
+        for (const char *now = begin; now != end; ++now) {
+            if (*now == ',') {
+                result.push_back("");
+            } else if (*now != '"' && *now != '\r' && !(charClass(*now) & ccBlank)) {
+                result.back() += *now;
+            }
+        }
+
+        return result;
+    }
+
+    // Parse a CSV line to row i of the chunk
+    // Fields may be quoted, missing or bad fields are NaN, extra fields are ignored
+    void parseLine(const char *begin, const char *end, StreamChunk &chunk, const size_t i) {
+        const char *now = begin;
+
+        for (vector <CalcData> &column: chunk.columns) {
+            CalcData value = NAN;
+
+            if (now < end) {
+                while (now < end && (charClass(*now) & ccBlank)) {
+                    ++now;
+                }
+
+                const bool quoted = now < end && *now == '"';
+                if (quoted) {
+                    ++now;
+                }
+
+                char *next;
+                value = strtod(now, &next);
+                if (next == now || next > end) {
+                    value = NAN;
+                }
+
+                if (quoted) {
+                    // The closing quote, after the number and blanks
+                    while (next < end && (charClass(*next) & ccBlank)) {
+                        ++next;
+                    }
+                    if (next >= end || *next != '"') {
+                        value = NAN;
+                    }
+
+                    // Commas in quotes are not separators
+                    now = (const char *) memchr(now, '"', end - now);
+                    now = now ? now + 1 : end;
+                }
+
+                // Skip to the next field
+                now = (const char *) memchr(now, ',', end - now);
+                now = now ? now + 1 : end + 1;
+            }
+
+            column[i] = value;
+        }
+    }
+
+    // Fill a chunk, return false at the end of input
+    // Binary input ending in a partial row sets partial to its bytes
+    bool readChunk(
+        BlockInput &input, const bool binary, const size_t chunkRows, StreamChunk &chunk, vector <CalcData> &row, size_t &partial
+    ) {
+        const size_t columnNum = chunk.columns.size();
+
+        for (vector <CalcData> &column: chunk.columns) {
+            column.resize(chunkRows);
+        }
+        chunk.rows = 0;
+
+        if (binary) {
+            // Rows of doubles, to columns
+            const size_t size = input.read((char *) row.data(), row.size() * sizeof(CalcData));
+            const size_t rows = size / (columnNum * sizeof(CalcData));
+            if (size % (columnNum * sizeof(CalcData)) != 0) {
+                partial = size % (columnNum * sizeof(CalcData));
+            }
+
+            for (size_t i = 0; i < rows; ++i) {
+                for (size_t j = 0; j < columnNum; ++j) {
+                    chunk.columns[j][i] = row[i * columnNum + j];
+                }
+            }
+            chunk.rows = rows;
+        } else {
+            const char *begin;
+            const char *end;
+
+            while (chunk.rows < chunkRows && input.getLine(begin, end)) {
+                // Skip empty lines
+                if (begin != end && !(end - begin == 1 && *begin == '\r')) {
+                    parseLine(begin, end, chunk, chunk.rows++);
+                }
+            }
+        }
+
+        return chunk.rows != 0;
+    }
+
+    // Write a CSV field, quoted if needed
+    void writeField(FILE *file, const Input &text) {
+        if (text.find_first_of(",\"\n") == Input::npos) {
+            fputs(text.c_str(), file);
+            return;
+        }
+
+        fputc('"', file);
+        for (const char c: text) {
+            if (c == '"') {
+                fputc('"', file);
+            }
+            fputc(c, file);
+        }
+        fputc('"', file);
+    }
+
+    // Formula and its name, "expr -> name" or expr
+    void splitFormula(const Input &text, Input &expr, Input &name) {
+        const size_t arrow = text.rfind("->");
+
+        expr = text;
+        name = text;
+
+        if (arrow != Input::npos) {
+            const InputIter begin = scanRun(text.begin() + arrow + 2, text.end(), ccBlank);
+            const InputIter end = scanRun(begin, text.end(), ccAlpha | ccDigit);
+
+            if (begin != end && (charClass(*begin) & ccAlpha) && scanRun(end, text.end(), ccBlank) == text.end()) {
+                expr = text.substr(0, arrow);
+                name = Input(begin, end);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    using namespace std;
+    using namespace OPParser;
+
+    vector <Input> columnNames;
+    bool binaryIn = 0;
+    bool binaryOut = 0;
+    FuncMode mode = fmExact;
+    size_t chunkRows = 65536;
+    vector <Input> formulas;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            binaryIn = 1;
+            columnNames = splitHeader(argv[i + 1], argv[i + 1] + strlen(argv[i + 1]));
+            ++i;
+        } else if (strcmp(argv[i], "-B") == 0) {
+            binaryOut = 1;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            mode = fmFast;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            chunkRows = max(atol(argv[++i]), 1l);
+        } else {
+            formulas.push_back(argv[i]);
+        }
+    }
+
+    // Binary data are in native byte order
+    const uint16_t order = 1;
+    if ((binaryIn || binaryOut) && *(const char *) &order != 1) {
+        cerr<<"Binary data need a little-endian machine"<<endl;
+        return 1;
+    }
+
+    if (formulas.empty()) {
+        cerr<<"Usage: calcstream [-b x,y,...] [-B] [-f] [-n rows] 'expr -> name' ... < input > output"<<endl;
+        return 1;
+    }
+
+    BlockInput input(stdin, 1 << 22);
+
+    if (!binaryIn) {
+        const char *begin;
+        const char *end;
+        if (!input.getLine(begin, end)) {
+            cerr<<"No header"<<endl;
+            return 1;
+        }
+        columnNames = splitHeader(begin, end);
+    }
+
+    // Columns are parameters of the programs
+    vector <Input> names;
+    vector <PCalcProgram> programs;
+    try {
+        Calc calc;
+        calc.init();
+
+        for (const Input &formula: formulas) {
+            Input expr;
+            Input name;
+            splitFormula(formula, expr, name);
+
+            names.push_back(name);
+            programs.push_back(calc.compile(expr, columnNames));
+        }
+    } catch (const opparser_error &e) {
+        cerr<<formulas[programs.size()]<<": "<<e.what()<<endl;
+        return 1;
+    }
+
+    // Chunks in use: one read, one calculated, one spare
+    ChunkQueue freeChunks;
+    ChunkQueue fullChunks;
+    for (int i = 0; i < 3; ++i) {
+        PStreamChunk chunk(new StreamChunk());
+        chunk->columns.resize(columnNames.size());
+        freeChunks.push(chunk);
+    }
+
+    // Read and parse, while the last chunk is calculated
+    size_t partial = 0;
+    thread reader([&]() {
+        vector <CalcData> row(binaryIn ? chunkRows * columnNames.size() : 0);
+
+        while (1) {
+            PStreamChunk chunk = freeChunks.pop();
+            const bool more = readChunk(input, binaryIn, chunkRows, *chunk, row, partial);
+
+            fullChunks.push(chunk);
+            if (!more) {
+                break;
+            }
+        }
+    });
+
+    if (!binaryOut) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (i) {
+                fputc(',', stdout);
+            }
+            writeField(stdout, names[i]);
+        }
+        fputc('\n', stdout);
+    }
+
+    // All formulas in one pass, with shared operations calculated once
+    const CalcPlan plan(programs);
+
+    const unsigned threads = calcThreads();
+    const size_t resultNum = programs.size();
+    vector <vector <CalcData> > results(resultNum, vector <CalcData> (chunkRows));
+    vector <CalcData> outRows(binaryOut ? chunkRows * resultNum : 0);
+    vector <Input> texts(threads);
+
+    while (1) {
+        const PStreamChunk chunk = fullChunks.pop();
+        if (chunk->rows == 0) {
+            break;
+        }
+
+        // Rows are split to threads, to calculate and format
+        const unsigned workerNum = chunk->rows >= 4096 ? threads : 1;
+
+        auto work = [&](const unsigned offset) {
+            const size_t begin = chunk->rows * offset / workerNum;
+            const size_t end = chunk->rows * (offset + 1) / workerNum;
+
+            vector <const CalcData *> params;
+            for (const vector <CalcData> &column: chunk->columns) {
+                params.push_back(column.data() + begin);
+            }
+
+            vector <CalcData *> targets;
+            for (vector <CalcData> &result: results) {
+                targets.push_back(result.data() + begin);
+            }
+
+            plan.runColumns(params.data(), targets.data(), end - begin, mode);
+
+            if (binaryOut) {
+                for (size_t i = begin; i < end; ++i) {
+                    for (size_t j = 0; j < resultNum; ++j) {
+                        outRows[i * resultNum + j] = results[j][i];
+                    }
+                }
+            } else {
+                Input &text = texts[offset];
+                char buffer[32];
+
+                text.clear();
+                for (size_t i = begin; i < end; ++i) {
+                    for (size_t j = 0; j < resultNum; ++j) {
+                        if (j) {
+                            text += ',';
+                        }
+                        text.append(buffer, snprintf(buffer, sizeof(buffer), "%.17g", results[j][i]));
+                    }
+                    text += '\n';
+                }
+            }
+        };
+
+        if (workerNum > 1) {
+            vector <thread> workers;
+            for (unsigned i = 0; i < workerNum; ++i) {
+                workers.push_back(thread(work, i));
+            }
+            for (thread &worker: workers) {
+                worker.join();
+            }
+        } else {
+            work(0);
+        }
+
+        // Write in order
+        if (binaryOut) {
+            fwrite(outRows.data(), sizeof(CalcData), chunk->rows * resultNum, stdout);
+        } else {
+            for (unsigned i = 0; i < workerNum; ++i) {
+                fwrite(texts[i].data(), 1, texts[i].size(), stdout);
+            }
+        }
+
+        freeChunks.push(chunk);
+    }
+
+    reader.join();
+
+    // Rows before it are written
+    if (partial) {
+        cerr<<"Input ends with a partial row of "<<partial<<" bytes"<<endl;
+        return 1;
+    }
+
+    return ferror(stdout) ? 1 : 0;
+}
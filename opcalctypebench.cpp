@@ -0,0 +1,123 @@
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "opcalc.hpp"
+
+// Compare value types of the calculator: speed and error against the widest type
+// Usage: ./typebench
+
+namespace OPParser {
+    // The widest type, as reference
+#if defined(CALC_FLOAT128)
+    typedef CalcQuad CalcWide;
+#else
+    typedef long double CalcWide;
+#endif
+
+    const vector <Input> benchExprs = {
+        "1 / 3 + 1 / 7",
+        "sqrt(2) * sqrt(3) - sqrt(6)",
+        "e ^ (log(10) / 3)",
+        "sin(pi / 7) ^ 2 + cos(pi / 7) ^ 2",
+        "gamma(5.5) / gamma(4.5)",
+        "(1 + 1 / 10000000) ^ 10000000",
+        "atan(1) * 4 - pi",
+        "integrate(e ^ -(x ^ 2), x, 0, 2)",
+        "solve(x ^ 3 - 2, x, 1)"
+    };
+
+    // A function of x for columns
+    const Input benchColumn = "sin(x) ^ 2 + log(x + 1) * sqrt(x) / (1 + x ^ 2)";
+
+    // Results of a type, for each expression
+    template <class T> struct TypeBench {
+        vector <CalcWide> values;
+
+        // Expressions per second, parsed and calculated
+        CalcData parseSpeed = 0;
+
+        // Rows per second, in millions
+        CalcData columnSpeed = 0;
+    };
+
+    template <class T> TypeBench <T> typeBench() {
+        const int rounds = 20;
+
+        TypeBench <T> result;
+        BasicCalc <T> calc;
+        calc.init();
+
+        for (const Input &expr: benchExprs) {
+            calc.parse(expr);
+            result.values.push_back(CalcWide(calc.finishByData()));
+        }
+
+        {
+            const auto begin = chrono::steady_clock::now();
+            for (int i = 0; i < rounds; ++i) {
+                for (const Input &expr: benchExprs) {
+                    calc.parse(expr);
+                    calc.finishByData();
+                }
+            }
+            const auto end = chrono::steady_clock::now();
+
+            result.parseSpeed = rounds * benchExprs.size() / chrono::duration <CalcData> (end - begin).count();
+        }
+
+        {
+            const size_t n = 1 << 16;
+            vector <T> xs(n);
+            vector <T> ys(n);
+            for (size_t i = 0; i < n; ++i) {
+                xs[i] = T(i) / n * 10;
+            }
+            const T *params[] = {xs.data()};
+
+            const PBasicCalcProgram <T> program = calc.compile(benchColumn, {"x"});
+
+            const auto begin = chrono::steady_clock::now();
+            for (int i = 0; i < rounds; ++i) {
+                program->runColumns(params, ys.data(), n, fmFast);
+            }
+            const auto end = chrono::steady_clock::now();
+
+            result.columnSpeed = n * rounds / chrono::duration <CalcData, micro> (end - begin).count();
+        }
+
+        return result;
+    }
+
+    // Print speeds and the max error against the widest type
+    // Error is relative above 1 and absolute below, as some results are near 0
+    template <class T> void printBench(const Input &name, const TypeBench <T> &bench, const TypeBench <CalcWide> &wide) {
+        CalcWide maxError = 0;
+
+        for (size_t i = 0; i < bench.values.size(); ++i) {
+            const CalcWide error = abs(bench.values[i] - wide.values[i]) / max(abs(wide.values[i]), CalcWide(1));
+
+            if (maxError < error) {
+                maxError = error;
+            }
+        }
+
+        printf("%-12s %6d %14.3g %14.0f %14.1f\n",
+            name.c_str(), calcDigits <T> (), double(maxError), bench.parseSpeed, bench.columnSpeed);
+    }
+}
+
+int main() {
+    using namespace std;
+    using namespace OPParser;
+
+    const TypeBench <CalcWide> wide = typeBench <CalcWide> ();
+
+    printf("%-12s %6s %14s %14s %14s\n", "type", "bits", "max error", "expr/s", "column M/s");
+
+    printBench("float", typeBench <float> (), wide);
+    printBench("double", typeBench <double> (), wide);
+    printBench("long double", typeBench <long double> (), wide);
+#if defined(CALC_FLOAT128)
+    printBench("__float128", wide, wide);
+#endif
+}
@@ -1,5 +1,7 @@
 #include <stdexcept>
 #include <limits>
+#include <mutex>
+#include <typeindex>
 #include "opparser.hpp"
 
 namespace OPParser {
@@ -32,62 +34,249 @@ namespace OPParser {
         }
 
         void onPop(Parser &parser) {
-            check(parser.midStack.empty(), "Input not completed");
+            if (!parser.midStack.empty()) {
+                parser.fail(ekNotCompleted);
+            }
         }
     };
 
     void Parser::reset() {
+        status = {ekNone, 0};
+        inputNum = 0;
+        tokenNum = 0;
         state = stateInitial;
         midStack.clear();
         outStack.clear();
+        timingParse = 0;
+        timingPush = 0;
+        timingPop = 0;
     }
 
     void Parser::init() {
         reset();
-        lexers.clear();
-        addFirstLexers();
-        addLastLexers();
+
+        if (lexers != nullptr) {
+            return;
+        }
+
+        // Lexers of each class of parsers
+        static mutex lock;
+        static map <type_index, shared_ptr <const LexerMap> > built;
+
+        lock_guard <mutex> guard(lock);
+
+        shared_ptr <const LexerMap> &found = built[typeid(*this)];
+        if (found == nullptr) {
+            shared_ptr <LexerMap> target(new LexerMap());
+            addFirstLexers(*target);
+            addLastLexers(*target);
+            found = target;
+        }
+
+        lexers = found;
+    }
+
+    void Parser::countInput(const size_t size) {
+        if (inputNum == 0 && budget.maxSeconds > 0) {
+            started = chrono::steady_clock::now();
+        }
+        inputNum += size;
+        if (budget.maxInput && inputNum > budget.maxInput) {
+            fail(ekInputTooLong);
+        }
+        if (!failed()) {
+            checkBudget();
+        }
+    }
+
+    void Parser::checkBudget() {
+        if (cancel != nullptr && cancel->load(memory_order_relaxed)) {
+            fail(ekCancelled);
+        } else if (budget.maxSeconds > 0
+                   && chrono::duration <double> (chrono::steady_clock::now() - started).count() > budget.maxSeconds) {
+            fail(ekTimeout);
+        }
+    }
+
+    // Nanoseconds from begin to now
+    static uint64_t nanosSince(const chrono::steady_clock::time_point begin) {
+        return chrono::duration_cast <chrono::nanoseconds> (chrono::steady_clock::now() - begin).count();
     }
 
     void Parser::midPush(const PToken token) {
+        // Lexing only, keep the state for the next lexers
+        if (lexing != nullptr) {
+            token->onPush(*this);
+            if (!token->save(*lexing)) {
+                fail(ekUnknownToken);
+                return;
+            }
+            lexing->offsets.push_back(status.offset);
+            return;
+        }
+
+        // Budget, time only every 64 tokens
+        ++tokenNum;
+        if (budget.maxTokens && tokenNum > budget.maxTokens) {
+            fail(ekTooManyTokens);
+            return;
+        }
+        if (tokenNum % 64 == 0) {
+            checkBudget();
+            if (failed()) {
+                return;
+            }
+        }
+
+        pushToken(token);
+    }
+
+    void Parser::pushToken(const PToken token) {
+        // Time all but onPop() as the stack
+        if (timing != nullptr && !timingPush) {
+            ParseTimes &times = *timing;
+            const uint64_t math = times.math;
+            const auto begin = chrono::steady_clock::now();
+
+            timingPush = 1;
+            pushToken(token);
+            timingPush = 0;
+
+            times.stack += nanosSince(begin) - (times.math - math);
+            return;
+        }
+
         token->onPush(*this);
 
         while (!midStack.empty()) {
             // Pop all lower-level tokens
             if (midStack.back()->levelRight() > token->levelLeft()) {
                 midPop();
+                if (failed()) {
+                    return;
+                }
                 continue;
             }
             if (midStack.back()->levelRight() < token->levelLeft()) {
                 break;
             }
             // Wrong
-            error("Token collision");
+            fail(ekTokenCollision);
+            return;
+        }
+
+        if (budget.maxDepth && midStack.size() >= budget.maxDepth) {
+            fail(ekTooDeep);
+            return;
         }
 
         midStack.push_back(token);
+        token->onPushed(*this);
     }
 
     // Pop from middle stack
     void Parser::midPop() {
-        check(!midStack.empty(), "No token to pop");
+        if (midStack.empty()) {
+            fail(ekNoTokenToPop);
+            return;
+        }
+
         PToken token(midStack.back());
         midStack.pop_back();
+
+        if (timing != nullptr && !timingPop) {
+            ParseTimes &times = *timing;
+            const auto begin = chrono::steady_clock::now();
+
+            timingPop = 1;
+            token->onPop(*this);
+            timingPop = 0;
+
+            times.math += nanosSince(begin);
+            return;
+        }
+
         token->onPop(*this);
     }
 
-    void Parser::parse(const Input &input) {
+    void Parser::fail(const int kind) {
+        if (!failed()) {
+            status.kind = kind;
+        }
+    }
+
+    void Parser::fail(const int kind, const size_t offset) {
+        if (!failed()) {
+            status.kind = kind;
+            status.offset = offset;
+        }
+    }
+
+    Input Parser::errorInfo(const int kind) const {
+        switch (kind) {
+        case ekNone:
+            return "No error";
+        case ekUnknownToken:
+            return "Unknown token";
+        case ekTokenCollision:
+            return "Token collision";
+        case ekNoTokenToPop:
+            return "No token to pop";
+        case ekNotCompleted:
+            return "Input not completed";
+        case ekInputTooLong:
+            return "Input too long";
+        case ekTooManyTokens:
+            return "Too many tokens";
+        case ekTooDeep:
+            return "Too deep";
+        case ekTimeout:
+            return "Time out";
+        case ekCancelled:
+            return "Cancelled";
+        default:
+            return "Unknown error";
+        }
+    }
+
+    ParseStatus Parser::tryParse(const Input &input) {
+        // Time all but the stack and onPop() as lexers
+        if (timing != nullptr && !timingParse) {
+            ParseTimes &times = *timing;
+            const uint64_t others = times.stack + times.math;
+            const auto begin = chrono::steady_clock::now();
+
+            timingParse = 1;
+            tryParse(input);
+            timingParse = 0;
+
+            times.lex += nanosSince(begin) - (times.stack + times.math - others);
+            return status;
+        }
+
         InputIter now = input.begin();
         const InputIter end = input.end();
 
+        countInput(input.size());
+
         // Scan input
-        while (now != end) {
-            vector <PLexer> &nowlexers = lexers[state];
+        while (now != end && !failed()) {
+            const auto found = lexers->find(state);
+            status.offset = now - input.begin();
+
+            if (found == lexers->end()) {
+                fail(ekUnknownToken);
+                break;
+            }
 
             // Scan the lexers chain
-            vector <PLexer>::iterator iter = nowlexers.begin();
+            const vector <PLexer> &nowlexers = found->second;
+            vector <PLexer>::const_iterator iter = nowlexers.begin();
             while (1) {
-                check(iter != nowlexers.end(), "Unknown token");
+                if (iter == nowlexers.end()) {
+                    fail(ekUnknownToken);
+                    break;
+                }
 
                 // Try lexers
                 if ((*iter)->tryGetToken(now, end, *this)) {
@@ -97,20 +286,86 @@ namespace OPParser {
                 ++iter;
             }
         }
+
+        if (!failed()) {
+            status.offset = input.size();
+        }
+        return status;
     }
 
-    void Parser::finish(vector <PToken> &result) {
-        // check(state == stateInitial, "Wrong finalize state");
+    ParseStatus Parser::tryLex(const Input &input, TokenBuffer &result) {
+        result = TokenBuffer();
+        result.inputSize = input.size();
 
-        // Clear middle stack
-        // Use a FinToken to pop everything
-        PToken token(new FinToken());
-        midPush(token);
-        midPop();
+        reset();
 
-        // Return outstack as result
-        result = outStack;
+        lexing = &result;
+        tryParse(input);
+        lexing = nullptr;
 
+        result.status = status;
         reset();
+
+        return result.status;
+    }
+
+    ParseStatus Parser::tryReplay(const TokenBuffer &tokens) {
+        countInput(tokens.inputSize);
+
+        for (size_t i = 0; i < tokens.kinds.size() && !failed(); ++i) {
+            status.offset = tokens.offsets[i];
+
+            // nullptr if the buffer is broken
+            const PToken token = loadToken(tokens, i);
+            if (token == nullptr) {
+                fail(ekUnknownToken);
+                break;
+            }
+
+            midPush(token);
+        }
+
+        // Errors of lexing come after the tokens before them
+        if (!failed()) {
+            status = tokens.status;
+        }
+        return status;
+    }
+
+    ParseStatus Parser::tryFinish(vector <PToken> &result) {
+        if (!failed()) {
+            // Clear middle stack
+            // Use a FinToken to pop everything
+            // Not counted in the budget
+            PToken token(new FinToken());
+            pushToken(token);
+            if (!failed()) {
+                midPop();
+            }
+
+            // Return outstack as result
+            result = outStack;
+        }
+
+        const ParseStatus finalStatus = status;
+        reset();
+
+        return finalStatus;
+    }
+
+    void Parser::parse(const Input &input) {
+        const ParseStatus result = tryParse(input);
+
+        if (result.kind != ekNone) {
+            error(errorInfo(result.kind));
+        }
+    }
+
+    void Parser::finish(vector <PToken> &result) {
+        const ParseStatus finalStatus = tryFinish(result);
+
+        if (finalStatus.kind != ekNone) {
+            error(errorInfo(finalStatus.kind));
+        }
     }
 }
@@ -5,6 +5,10 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
 // The namespace of the operator-precedence parser
 namespace OPParser {
@@ -33,6 +37,9 @@ namespace OPParser {
     typedef shared_ptr <Lexer> PLexer;
     typedef shared_ptr <Token> PToken;
 
+    // Lexers chains of states
+    typedef map <State, vector <PLexer> > LexerMap;
+
     // Throw error
     void error(const string &info);
 
@@ -46,6 +53,80 @@ namespace OPParser {
         opparser_error(const string &e): runtime_error(e){}
     };
 
+    // Kinds of errors of the parser
+    // Derived parsers add their kinds from ekUser
+    enum ErrorKind {
+        ekNone, ekUnknownToken, ekTokenCollision, ekNoTokenToPop, ekNotCompleted,
+        ekInputTooLong, ekTooManyTokens, ekTooDeep, ekTimeout, ekCancelled, ekUser = 64
+    };
+
+    // Limits of one expression, from the first parse to finishing, 0 for no limit
+    struct ParseBudget {
+        // Characters of input, over all parse() calls
+        size_t maxInput = 0;
+
+        // Tokens pushed
+        size_t maxTokens = 0;
+
+        // Size of the middle stack, like nesting of brackets
+        // The operand being read counts too, so "((1))" needs 3
+        size_t maxDepth = 0;
+
+        // Wall-clock time, checked every few tokens
+        double maxSeconds = 0;
+    };
+
+    // Time of parsing by stage, in nanoseconds, added up over expressions
+    struct ParseTimes {
+        // In lexers
+        uint64_t lex = 0;
+
+        // In the stacks, popping by precedence
+        uint64_t stack = 0;
+
+        // In onPop() of tokens, calculating (or compiling)
+        uint64_t math = 0;
+    };
+
+    // Result of parsing, without exceptions
+    struct ParseStatus {
+        // ErrorKind, or kinds of derived parsers
+        int kind;
+
+        // Offset in the input where the error is found
+        size_t offset;
+    };
+
+    // Tokens of an input, lexed but not parsed, see Parser::tryLex()
+    // Structure of arrays, one item of kinds, payloads and offsets per token
+    // Kinds and payloads are defined by derived parsers
+    struct TokenBuffer {
+        vector <int> kinds = {};
+        vector <uint64_t> payloads = {};
+
+        // Offset in the input where each token is found
+        vector <size_t> offsets = {};
+
+        // Texts referred by payloads, like names
+        vector <Input> texts = {};
+
+        // Size of the input, and the status of lexing
+        size_t inputSize = 0;
+        ParseStatus status = {ekNone, 0};
+
+        // Add a token, its offset is added by the parser
+        void push(const int kind, const uint64_t payload) {
+            kinds.push_back(kind);
+            payloads.push_back(payload);
+        }
+
+        // Add a text, return its index
+        uint64_t pushText(const Input &text) {
+            texts.push_back(text);
+            return texts.size() - 1;
+        }
+    };
+
     // Lexer particle, recognise token from string
     // Chain-factory, to create token
     class Lexer: public enable_shared_from_this <Lexer>{
@@ -67,10 +148,21 @@ namespace OPParser {
         // To change the state of lexers
         virtual void onPush(Parser &parser) = 0;
 
+        // After pushed to middle stack
+        // To start parts which depend on the operands before
+        virtual void onPushed(Parser &parser) {}
+
         // Pop from middle stack
         // To build final data (using data from output stack)
         // And to push data to output stack
         virtual void onPop(Parser &parser) = 0;
+
+        // Add kind and payload to a token buffer, see Parser::tryLex()
+        // Parser::loadToken() should make the same token again
+        // Return false if it can not be saved (by default), then lexing fails
+        virtual bool save(TokenBuffer &tokens) const {
+            return 0;
+        }
     };
 
     // The operator-precedence parser
@@ -79,37 +171,127 @@ namespace OPParser {
     class Parser {
     protected:
         // Map of lexers chains
-        map <State, vector <PLexer> > lexers = {};
+        // Built once for each class of parsers by init(), then shared and never changed
+        shared_ptr <const LexerMap> lexers = nullptr;
+
+        // The first error, and the offset of the token being read
+        ParseStatus status = {ekNone, 0};
+
+        // Used of the budget
+        size_t inputNum = 0;
+        size_t tokenNum = 0;
+        chrono::steady_clock::time_point started = {};
+
+        // Tokens are added here instead of being pushed, if lexing only
+        TokenBuffer *lexing = nullptr;
+
+        // Being timed, so nested calls are not timed again
+        bool timingParse = 0;
+        bool timingPush = 0;
+        bool timingPop = 0;
+
+        // Count input for the budget, and start the timer
+        void countInput(const size_t size);
+
+        // Check time and cancellation
+        void checkBudget();
+
+        // Push to middle stack, like midPush() but not counted in the budget
+        void pushToken(const PToken token);
 
         // Reset
         // Clean up and start parsing
-        void reset();
+        // Derived parsers clean up their own states too
+        virtual void reset();
 
         // Add first-round lexers
-        virtual void addFirstLexers() = 0;
+        // Lexers should depend only on the class, as they are shared
+        virtual void addFirstLexers(LexerMap &target) = 0;
 
         // Add last-round lexers
-        virtual void addLastLexers() = 0;
+        virtual void addLastLexers(LexerMap &target) = 0;
+
+        // Make a token from a token buffer, see Token::save()
+        // Return nullptr if the item is broken, or if not supported (by default)
+        virtual PToken loadToken(const TokenBuffer &tokens, const size_t index) const {
+            return nullptr;
+        }
     public:
         State state = stateInitial;
         vector <PToken> midStack = {};
         vector <PToken> outStack = {};
 
+        // Limits of each expression, none by default
+        ParseBudget budget = {};
+
+        // Set by another thread to stop parsing, nullptr for none
+        // Checked with the budget
+        const atomic <bool> *cancel = nullptr;
+
+        // Add time of each stage here, nullptr for none (default)
+        // Costs a few clock reads for each token
+        ParseTimes *timing = nullptr;
+
         // Initialization
         // Will call reset() here
+        // Lexers are built at the first time of the class, then shared
         void init();
 
+        // Clean up after errors, like init() but only reset() is needed
+        // Lexers are kept, so the cost does not depend on them
+        void recover() {
+            reset();
+        }
+
         // Push to middle stack
         void midPush(const PToken token);
 
         // Pop from middle stack
         void midPop();
 
+        // Record an error (only the first one is kept)
+        // Lexers and tokens should return after it, and parsing stops
+        void fail(const int kind);
+
+        // Record an error at an offset of the input, like of a token read before
+        void fail(const int kind, const size_t offset);
+
+        bool failed() const {
+            return status.kind != ekNone;
+        }
+
+        // Offset of the token being read
+        size_t getOffset() const {
+            return status.offset;
+        }
+
+        // Message of an error kind
+        virtual Input errorInfo(const int kind) const;
+
         // Parse a string
         // Push data to lexers
-        void parse(const Input &input);
+        // Return the status instead of throwing errors
+        ParseStatus tryParse(const Input &input);
+
+        // Lex a string without parsing, into result
+        // Tokens are not pushed, but onPush() is called, so lexers still follow the state
+        // Will call reset() here, before and after lexing
+        // Return the status of lexing, also kept in result
+        ParseStatus tryLex(const Input &input, TokenBuffer &result);
+
+        // Parse tokens from tryLex(), like tryParse() with the same input
+        // The buffer is not changed, so it can be parsed again (or by another parser)
+        ParseStatus tryReplay(const TokenBuffer &tokens);
 
         // Finish parsing
+        // Will call reset() here, even if failed
+        // Return the status (or the status of parsing) instead of throwing errors
+        ParseStatus tryFinish(vector <PToken> &result);
+
+        // Parse a string, throw errors
+        void parse(const Input &input);
+
+        // Finish parsing, throw errors
         // Will call reset() here
         void finish(vector <PToken> &result);
     };
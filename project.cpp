@@ -1,10 +1,63 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include "opcalcrepl.hpp"
 
-int main() {
+int main(int argc, char *argv[]) {
     using namespace std;
     using namespace OPParser;
 
     CalcRepl calc;
+
+    // -r: reactive mode
+    // -s file: load the snapshot file if any, and save it at exit
+    // -t tolerance: relative tolerance of near values
+    // -m file: record latency of expressions, and write it to the file at exit
+    Input snapshot = "";
+    Input statsPath = "";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0) {
+            calc.reactive = 1;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            snapshot = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            calc.nearTolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            statsPath = argv[++i];
+        }
+    }
+
+    if (snapshot != "" && ifstream(snapshot)) {
+        try {
+            calc.load(snapshot);
+        } catch (const opparser_error &e) {
+            cerr<<e.what()<<endl;
+        }
+    }
+
+    CalcStats stats;
+    if (statsPath != "") {
+        calc.stats = &stats;
+    }
+
     calc.run("q");
+
+    if (statsPath != "") {
+        ofstream file(statsPath);
+        stats.dump(file);
+        if (!file) {
+            cerr<<"Cannot write "<<statsPath<<endl;
+            return 1;
+        }
+    }
+
+    if (snapshot != "") {
+        try {
+            calc.save(snapshot);
+        } catch (const opparser_error &e) {
+            cerr<<e.what()<<endl;
+            return 1;
+        }
+    }
 }